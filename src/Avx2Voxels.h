@@ -0,0 +1,119 @@
+#pragma once
+
+// Helpers shared by the translation units compiled for AVX2. Include this header only there:
+// the inline functions below must never be compiled into code running on CPUs without AVX2.
+// For the same reason these units do not use any templates of the standard library.
+
+#include "TrilinearAvx2.h"
+#include "BrickConstants.h"
+
+#include <immintrin.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// AVX2 Voxel Access
+//-------------------------------------------------------------------------------------------------
+
+namespace avx2
+{
+	// The index of a voxel is the sum of one offset per axis. For bricks the brick number and
+	// the position inside the brick use separate bits, so the offsets can be added as well.
+
+	struct LinearAxes
+	{
+		LinearAxes(const VoxelGrid &grid)
+			: strideY(_mm256_set1_epi32(grid.width)),
+			  strideZ(_mm256_set1_epi32(grid.width * grid.height))
+		{
+		}
+
+		__m256i x(const __m256i v) const { return v; }
+		__m256i y(const __m256i v) const { return _mm256_mullo_epi32(v, strideY); }
+		__m256i z(const __m256i v) const { return _mm256_mullo_epi32(v, strideZ); }
+
+		__m256i					strideY;
+		__m256i					strideZ;
+	};
+
+	struct BrickedAxes
+	{
+		BrickedAxes(const VoxelGrid &grid)
+		{
+			const int bricksX = (grid.width + BrickConstants::BRICK - 1) >> BrickConstants::BRICK_SHIFT;
+			const int bricksY = (grid.height + BrickConstants::BRICK - 1) >> BrickConstants::BRICK_SHIFT;
+
+			brickY = _mm256_set1_epi32(bricksX * BrickConstants::BRICK_VOXELS);
+			brickZ = _mm256_set1_epi32(bricksX * bricksY * BrickConstants::BRICK_VOXELS);
+			mask = _mm256_set1_epi32(BrickConstants::BRICK_MASK);
+		}
+
+		__m256i x(const __m256i v) const
+		{
+			const __m256i brick = _mm256_slli_epi32(_mm256_srli_epi32(v, BrickConstants::BRICK_SHIFT), 3 * BrickConstants::BRICK_SHIFT);
+			return _mm256_or_si256(brick, _mm256_and_si256(v, mask));
+		}
+
+		__m256i y(const __m256i v) const
+		{
+			const __m256i brick = _mm256_mullo_epi32(_mm256_srli_epi32(v, BrickConstants::BRICK_SHIFT), brickY);
+			return _mm256_or_si256(brick, _mm256_slli_epi32(_mm256_and_si256(v, mask), BrickConstants::BRICK_SHIFT));
+		}
+
+		__m256i z(const __m256i v) const
+		{
+			const __m256i brick = _mm256_mullo_epi32(_mm256_srli_epi32(v, BrickConstants::BRICK_SHIFT), brickZ);
+			return _mm256_or_si256(brick, _mm256_slli_epi32(_mm256_and_si256(v, mask), 2 * BrickConstants::BRICK_SHIFT));
+		}
+
+		__m256i					brickY;
+		__m256i					brickZ;
+		__m256i					mask;
+	};
+
+	// Gathers read 32bit per lane. Narrower voxels are read from at most `last`, the last
+	// element a 32bit read may start at, and shifted into place, so that no read passes the
+	// end of the data (which may be a mapped file without any padding).
+
+	inline __m256 gather(const float *data, const float * /*lut*/, const __m256i index, const __m256i /*last*/)
+	{
+		return _mm256_i32gather_ps(data, index, 4);
+	}
+
+	inline __m256 gather(const unsigned short *data, const float *lut, const __m256i index, const __m256i last)
+	{
+		const __m256i start = _mm256_min_epi32(index, last);
+		const __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(index, start), 4);
+
+		__m256i value = _mm256_i32gather_epi32((const int*)data, start, 2);
+		value = _mm256_and_si256(_mm256_srlv_epi32(value, shift), _mm256_set1_epi32(0xFFFF));
+		value = _mm256_min_epi32(value, _mm256_set1_epi32(4095));
+
+		return _mm256_i32gather_ps(lut, value, 4);
+	}
+
+	inline __m256 gather(const unsigned char *data, const float *lut, const __m256i index, const __m256i last)
+	{
+		const __m256i start = _mm256_min_epi32(index, last);
+		const __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(index, start), 3);
+
+		__m256i value = _mm256_i32gather_epi32((const int*)data, start, 1);
+		value = _mm256_and_si256(_mm256_srlv_epi32(value, shift), _mm256_set1_epi32(0xFF));
+
+		return _mm256_i32gather_ps(lut, value, 4);
+	}
+
+	inline __m256 lerp(const __m256 a, const __m256 b, const __m256 t)
+	{
+		return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+	}
+
+	// lower corner, upper corner and fraction of eight clamped coordinates along one axis
+	inline void corners(const float *position, const int size, __m256i &lower, __m256i &upper, __m256 &fraction)
+	{
+		const __m256 clamped = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(position), _mm256_setzero_ps()), _mm256_set1_ps(float(size - 1)));
+
+		lower = _mm256_cvttps_epi32(clamped);
+		upper = _mm256_min_epi32(_mm256_add_epi32(lower, _mm256_set1_epi32(1)), _mm256_set1_epi32(size - 1));
+		fraction = _mm256_sub_ps(clamped, _mm256_cvtepi32_ps(lower));
+	}
+}
@@ -0,0 +1,305 @@
+
+#include "Volume.h"
+#include "ImageFile.h"
+#include "CpuFeatures.h"
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include <math.h>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+
+//-------------------------------------------------------------------------------------------------
+// Batch Renderer
+//-------------------------------------------------------------------------------------------------
+
+// Renders one frame of a .dat volume without any window or OpenGL context and writes it to a
+// PGM or PFM file, e.g.
+//
+//   Batch head.dat head_mip.pgm --mode mip --samples 2 --scale 2
+//
+// With --repeat N the frame is rendered N times and the timing of every frame is printed,
+// which gives reproducible measurements on machines without a display. --yaw, --pitch and
+// --fov switch from the projection along z to a camera orbiting the volume centre. With
+// --save-bricks the loaded volume is also written as a compressed brick file, which loads and
+// streams in place of the .dat file.
+
+namespace
+{
+	void printUsage()
+	{
+		std::cout << "usage: Batch <volume.dat> <output.pgm|output.pfm> [options]" << std::endl
+			<< std::endl
+			<< "  --mode mip|firsthit|average|alpha   compositing mode (mip)" << std::endl
+			<< "  --samples N                         sample distance (1)" << std::endl
+			<< "  --transparency A                    transparency of alpha compositing (0.1)" << std::endl
+			<< "  --termination T                     opacity ending alpha compositing rays (0.99)" << std::endl
+			<< "  --scale N                           scale factor of the image (1)" << std::endl
+			<< "  --storage float|uint16|uint8        voxel storage (uint16)" << std::endl
+			<< "  --layout linear|bricked             voxel layout (linear)" << std::endl
+			<< "  --traversal auto|ray|slice|packet   volume traversal (auto)" << std::endl
+			<< "  --upsampling rays|bilinear|bicubic  how scaled images are produced (rays)" << std::endl
+			<< "  --mapped                            map the file instead of reading it" << std::endl
+			<< "  --stream MB                         stream bricks from the file through a cache of MB megabytes" << std::endl
+			<< "  --save-bricks FILE                  write the volume as a compressed brick file" << std::endl
+			<< "  --column-tables                     serve unscaled MIP, average and first hit from column tables" << std::endl
+			<< "  --no-skipping                       disable empty-space skipping" << std::endl
+			<< "  --lod                               render coarse sample distances from the volume pyramid" << std::endl
+			<< "  --no-simd                           use the scalar code even if the CPU has AVX2" << std::endl
+			<< "  --repeat N                          render the frame N times (1)" << std::endl
+			<< "  --yaw D, --pitch D                  orbit the camera by D degrees (0)" << std::endl
+			<< "  --fov D                             perspective with D degrees field of view (orthographic)" << std::endl
+			<< "  --step L                            sample distance along camera rays in voxels (1.0)" << std::endl;
+	}
+
+	bool parseInt(const std::string &text, int minimum, int &value)
+	{
+		char *end = 0;
+		const long parsed = strtol(text.c_str(), &end, 10);
+		if (end == text.c_str() || *end != '\0' || parsed < minimum) return false;
+
+		value = int(parsed);
+		return true;
+	}
+
+	bool parseFloat(const std::string &text, float &value)
+	{
+		char *end = 0;
+		const double parsed = strtod(text.c_str(), &end);
+		if (end == text.c_str() || *end != '\0') return false;
+
+		value = float(parsed);
+		return true;
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+
+	if (argc < 3)
+	{
+		printUsage();
+		return 1;
+	}
+
+	const std::string input = argv[1];
+	const std::string output = argv[2];
+
+	Volume::RenderMode mode = Volume::MIP;
+	Volume::Storage storage = Volume::STORAGE_UINT16;
+	Volume::Layout layout = Volume::LAYOUT_LINEAR;
+	Volume::Traversal traversal = Volume::TRAVERSAL_AUTO;
+	Volume::Upsampling upsampling = Volume::UPSAMPLE_RAYS;
+	int samples = 1;
+	int scale = 1;
+	int repeat = 1;
+	float transparency = 0.1f;
+	float threshold = 0.99f;
+	bool camera = false;
+	float yaw = 0.0f;
+	float pitch = 0.0f;
+	float fov = 0.0f;
+	float step = 1.0f;
+	bool mapped = false;
+	int streamBudget = 0;
+	std::string brickFile;
+	bool skipping = true;
+	bool columnTables = false;
+	bool levels = false;
+
+	// parse options
+
+	for (int i = 3; i < argc; i++)
+	{
+		const std::string option = argv[i];
+		const std::string argument = (i + 1 < argc) ? argv[i + 1] : "";
+		bool valid = true;
+
+		if (option == "--mapped")
+		{
+			mapped = true;
+			continue;
+		}
+		else if (option == "--no-skipping")
+		{
+			skipping = false;
+			continue;
+		}
+		else if (option == "--column-tables")
+		{
+			columnTables = true;
+			continue;
+		}
+		else if (option == "--lod")
+		{
+			levels = true;
+			continue;
+		}
+		else if (option == "--no-simd")
+		{
+			setAvx2Enabled(false);
+			continue;
+		}
+		else if (option == "--mode")
+		{
+			if (argument == "mip") mode = Volume::MIP;
+			else if (argument == "firsthit") mode = Volume::FIRST_HIT;
+			else if (argument == "average") mode = Volume::AVERAGE;
+			else if (argument == "alpha") mode = Volume::ALPHA_COMPOSITING;
+			else valid = false;
+		}
+		else if (option == "--storage")
+		{
+			if (argument == "float") storage = Volume::STORAGE_FLOAT;
+			else if (argument == "uint16") storage = Volume::STORAGE_UINT16;
+			else if (argument == "uint8") storage = Volume::STORAGE_UINT8;
+			else valid = false;
+		}
+		else if (option == "--layout")
+		{
+			if (argument == "linear") layout = Volume::LAYOUT_LINEAR;
+			else if (argument == "bricked") layout = Volume::LAYOUT_BRICKED;
+			else valid = false;
+		}
+		else if (option == "--traversal")
+		{
+			if (argument == "auto") traversal = Volume::TRAVERSAL_AUTO;
+			else if (argument == "ray") traversal = Volume::RAY_MAJOR;
+			else if (argument == "slice") traversal = Volume::SLICE_MAJOR;
+			else if (argument == "packet") traversal = Volume::RAY_PACKETS;
+			else valid = false;
+		}
+		else if (option == "--upsampling")
+		{
+			if (argument == "rays") upsampling = Volume::UPSAMPLE_RAYS;
+			else if (argument == "bilinear") upsampling = Volume::UPSAMPLE_BILINEAR;
+			else if (argument == "bicubic") upsampling = Volume::UPSAMPLE_BICUBIC;
+			else valid = false;
+		}
+		else if (option == "--samples") valid = parseInt(argument, 1, samples);
+		else if (option == "--scale") valid = parseInt(argument, 1, scale);
+		else if (option == "--repeat") valid = parseInt(argument, 1, repeat);
+		else if (option == "--stream") valid = parseInt(argument, 1, streamBudget);
+		else if (option == "--save-bricks") valid = !(brickFile = argument).empty();
+		else if (option == "--transparency") valid = parseFloat(argument, transparency);
+		else if (option == "--termination") valid = parseFloat(argument, threshold) && threshold > 0.0f;
+		else if (option == "--yaw") valid = camera = parseFloat(argument, yaw);
+		else if (option == "--pitch") valid = camera = parseFloat(argument, pitch);
+		else if (option == "--fov") valid = camera = parseFloat(argument, fov) && fov > 0.0f && fov < 180.0f;
+		else if (option == "--step") valid = parseFloat(argument, step) && step > 0.0f;
+		else
+		{
+			std::cerr << "+ Unknown option: " << option << std::endl;
+			printUsage();
+			return 1;
+		}
+
+		if (!valid)
+		{
+			std::cerr << "+ Invalid value for " << option << ": " << argument << std::endl;
+			return 1;
+		}
+
+		i++;
+	}
+
+	// load volume
+
+	Volume volume;
+	volume.setStorage(storage);
+	volume.setLayout(layout);
+	volume.setMemoryMapped(mapped);
+	volume.setStreamed(streamBudget > 0);
+	volume.setCacheBudget((long long)streamBudget << 20);
+	volume.setLevelOfDetail(levels);
+
+	if (!volume.loadFromFile(QString::fromStdString(input)))
+	{
+		return 1;
+	}
+
+	std::cout << "Batch loaded " << input << " [" << volume.width() << " x " << volume.height() << " x " << volume.depth() << "]" << std::endl;
+
+	if (!brickFile.empty() && !volume.saveBrickFile(QString::fromStdString(brickFile)))
+	{
+		return 1;
+	}
+
+	switch (mode)
+	{
+		case Volume::MIP:				volume.setMip(); break;
+		case Volume::FIRST_HIT:			volume.setFirstHit(); break;
+		case Volume::AVERAGE:			volume.setAverage(); break;
+		case Volume::ALPHA_COMPOSITING:	volume.setAlphaCompositing(); break;
+	}
+
+	volume.setSampleDistance(samples);
+	volume.setScaleFactor(scale);
+	volume.setTransparency(transparency);
+	volume.setTerminationThreshold(threshold);
+	volume.setTraversal(traversal);
+	volume.setUpsampling(upsampling);
+	volume.setEmptySpaceSkipping(skipping);
+	volume.setColumnTables(columnTables);
+	volume.setStepLength(step);
+
+	if (camera)
+	{
+		// the camera orbits the volume centre; yaw 0 and pitch 0 look along +z like the projection
+		const float diagonal = sqrtf(float(volume.width() * volume.width() + volume.height() * volume.height() + volume.depth() * volume.depth()));
+		const float distance = 2.0f * diagonal;
+		const float aspect = float(volume.width()) / float(volume.height());
+
+		const glm::vec3 eye = distance * glm::vec3(
+			sinf(glm::radians(yaw)) * cosf(glm::radians(pitch)),
+			sinf(glm::radians(pitch)),
+			-cosf(glm::radians(yaw)) * cosf(glm::radians(pitch)));
+		const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		const float halfHeight = 0.5f * diagonal;
+		const glm::mat4 projection = (fov > 0.0f) ?
+			glm::perspective(glm::radians(fov), aspect, 0.1f, distance + diagonal) :
+			glm::ortho(-halfHeight * aspect, halfHeight * aspect, -halfHeight, halfHeight, 0.1f, distance + diagonal);
+
+		volume.setCamera(view, projection);
+	}
+
+	// render
+
+	std::vector<float> pixels;
+
+	for (int frame = 0; frame < repeat; frame++)
+	{
+		pixels = volume.rayCasting2();
+
+		const Volume::RenderStats &stats = volume.renderStats();
+		std::cout << "Batch frame " << frame << ": " << stats.milliseconds << " ms, " << stats.samples << " samples ("
+			<< (stats.milliseconds > 0.0 ? stats.samples / stats.milliseconds / 1000.0 : 0.0) << " MSamples/s), "
+			<< stats.skippedSamples << " skipped, " << stats.reusedPixels << " pixels reused, "
+			<< stats.averageRayLength << " samples per ray, level " << stats.level << ", "
+			<< stats.bricksLoaded << " bricks loaded" << std::endl;
+	}
+
+	// the volume has reported why the image could not be rendered
+	if (pixels.empty()) return 1;
+
+	// write image
+
+	const int width = volume.width() * volume.getScaleFactor();
+	const int height = volume.height() * volume.getScaleFactor();
+
+	if (!writeImage(output, pixels, width, height))
+	{
+		std::cerr << "+ Error writing image: " << output << std::endl;
+		return 1;
+	}
+
+	std::cout << "Batch wrote " << output << " [" << width << " x " << height << "]" << std::endl;
+
+	return 0;
+
+}
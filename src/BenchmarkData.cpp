@@ -0,0 +1,150 @@
+#include "BenchmarkData.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <math.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// Synthetic Datasets
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+	float lattice(int x, int y, int z)
+	{
+		return float(voxelHash(x, y, z) & 0xffff) / 65535.0f;
+	}
+
+	// trilinear interpolation of random values on a lattice with the given cell size
+	float valueNoise(int x, int y, int z, int cell)
+	{
+		const int x0 = x / cell, y0 = y / cell, z0 = z / cell;
+		const float fx = float(x % cell) / cell, fy = float(y % cell) / cell, fz = float(z % cell) / cell;
+
+		float v = 0.0f;
+		for (int i = 0; i < 8; i++)
+		{
+			const int dx = i & 1, dy = (i >> 1) & 1, dz = (i >> 2) & 1;
+			const float w = (dx ? fx : 1.0f - fx) * (dy ? fy : 1.0f - fy) * (dz ? fz : 1.0f - fz);
+			v += w * lattice(x0 + dx, y0 + dy, z0 + dz);
+		}
+		return v;
+	}
+
+}
+
+const char* datasetName(Dataset dataset)
+{
+	switch (dataset)
+	{
+		case SPHERE:	return "sphere";
+		case NOISE:		return "noise";
+		case PHANTOM:	return "phantom";
+	}
+	return "";
+}
+
+unsigned int voxelHash(unsigned int x, unsigned int y, unsigned int z)
+{
+	unsigned int h = x * 73856093u ^ y * 19349663u ^ z * 83492791u;
+	h ^= h >> 13;
+	h *= 0x5bd1e995u;
+	h ^= h >> 15;
+	return h;
+}
+
+std::vector<unsigned short> generateVolume(Dataset dataset, int n)
+{
+	std::vector<unsigned short> voxels(size_t(n) * n * n, 0);
+
+	const float center = 0.5f * (n - 1);
+	const float radius = 0.45f * n;
+
+	// blob centres of the phantom, away from the borders
+	const int blobs = 8;
+	const float blobRadius = n / 16.0f;
+	std::vector<float> blobCenters;
+	for (int b = 0; b < blobs * 3; b++)
+	{
+		blobCenters.push_back((0.2f + 0.6f * lattice(b, 17, 31)) * n);
+	}
+
+	ThreadPool::instance().parallelFor(n, [&](int z)
+	{
+		for (int y = 0; y < n; y++)
+		{
+			unsigned short *row = &voxels[(size_t(z) * n + y) * n];
+
+			for (int x = 0; x < n; x++)
+			{
+				float value = 0.0f;
+
+				if (dataset == SPHERE)
+				{
+					const float dx = x - center, dy = y - center, dz = z - center;
+					const float d = sqrtf(dx * dx + dy * dy + dz * dz) / radius;
+					value = d < 1.0f ? 1.0f - 0.75f * d : 0.0f;
+				}
+				else if (dataset == NOISE)
+				{
+					value = valueNoise(x, y, z, 8);
+				}
+				else if (dataset == PHANTOM)
+				{
+					for (int b = 0; b < blobs; b++)
+					{
+						const float dx = x - blobCenters[3 * b], dy = y - blobCenters[3 * b + 1], dz = z - blobCenters[3 * b + 2];
+						const float d = sqrtf(dx * dx + dy * dy + dz * dz) / blobRadius;
+						if (d < 1.0f) value = std::max(value, 1.0f - 0.5f * d);
+					}
+				}
+
+				row[x] = (unsigned short)(value * 4095.0f + 0.5f);
+			}
+		}
+	});
+
+	return voxels;
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Render Settings
+//-------------------------------------------------------------------------------------------------
+
+const char* modeName(Volume::RenderMode mode)
+{
+	switch (mode)
+	{
+		case Volume::MIP:				return "mip";
+		case Volume::FIRST_HIT:			return "firsthit";
+		case Volume::AVERAGE:			return "average";
+		case Volume::ALPHA_COMPOSITING:	return "alpha";
+	}
+	return "";
+}
+
+const char* traversalName(Volume::Traversal traversal)
+{
+	switch (traversal)
+	{
+		case Volume::TRAVERSAL_AUTO:	return "auto";
+		case Volume::RAY_MAJOR:			return "ray";
+		case Volume::SLICE_MAJOR:		return "slice";
+		case Volume::RAY_PACKETS:		return "packet";
+	}
+	return "";
+}
+
+void setMode(Volume &volume, Volume::RenderMode mode)
+{
+	switch (mode)
+	{
+		case Volume::MIP:				volume.setMip(); break;
+		case Volume::FIRST_HIT:			volume.setFirstHit(); break;
+		case Volume::AVERAGE:			volume.setAverage(); break;
+		case Volume::ALPHA_COMPOSITING:	volume.setAlphaCompositing(); break;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Volume.h"
+
+#include <vector>
+
+
+//-------------------------------------------------------------------------------------------------
+// Synthetic Datasets
+//-------------------------------------------------------------------------------------------------
+
+// volumes generated for the Benchmark and Tests programs, the same voxels on every run
+
+enum Dataset
+{
+	SPHERE				= 0,		// dense ball with a radial falloff
+	NOISE				= 1,		// smooth value noise filling the whole volume
+	PHANTOM				= 2			// a few small blobs in a mostly empty volume
+};
+
+const char*					datasetName(Dataset dataset);
+
+// deterministic integer hash, so that every run generates the same voxels
+unsigned int				voxelHash(unsigned int x, unsigned int y, unsigned int z);
+
+// 12bit voxels of an n^3 volume, x fastest
+std::vector<unsigned short>	generateVolume(Dataset dataset, int n);
+
+
+//-------------------------------------------------------------------------------------------------
+// Render Settings
+//-------------------------------------------------------------------------------------------------
+
+// names as the command line options take them
+const char*					modeName(Volume::RenderMode mode);
+const char*					traversalName(Volume::Traversal traversal);
+
+void						setMode(Volume &volume, Volume::RenderMode mode);
@@ -0,0 +1,466 @@
+
+#include "Volume.h"
+#include "BenchmarkData.h"
+#include "ThreadPool.h"
+#include "CpuFeatures.h"
+#include "VoxelConversion.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <math.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// Ray Casting Benchmark
+//-------------------------------------------------------------------------------------------------
+
+// Generates synthetic volumes of several sizes and sparsity patterns and times every
+// compositing mode across sample distances and scale factors, e.g.
+//
+//   Benchmark --sizes 64,128,256 --frames 5 --output results.json
+//
+// Every configuration is rendered once to warm up and then --frames times. The results are
+// written as JSON, one record per configuration, so that runs of different builds can be
+// compared. The bandwidth is the effective rate of voxel data read by the samples (eight voxels
+// per interpolated sample), not a measurement of the memory bus.
+
+namespace
+{
+
+	//---------------------------------------------------------------------------------------------
+	// Conversion Benchmark
+	//---------------------------------------------------------------------------------------------
+
+	// Times the conversion of the 16bit file values into float and 8bit voxels on its own, as
+	// the loader runs it after reading a file: value by value with convertVoxel(), with
+	// convertVoxels() on one thread, and with convertVoxels() on all threads. Every method has
+	// to give the voxels of the first one.
+
+	enum ConversionMethod
+	{
+		CONVERT_SCALAR		= 0,
+		CONVERT_SIMD		= 1,
+		CONVERT_PARALLEL	= 2
+	};
+
+	const char* conversionName(ConversionMethod method)
+	{
+		switch (method)
+		{
+			case CONVERT_SCALAR:	return "scalar";
+			case CONVERT_SIMD:		return "simd";
+			case CONVERT_PARALLEL:	return "parallel";
+		}
+		return "";
+	}
+
+	template<typename T>
+	void convert(ConversionMethod method, const std::vector<unsigned short> &values, std::vector<T> &voxels)
+	{
+		const int BLOCK = 1 << 16;
+
+		if (method == CONVERT_SCALAR)
+		{
+			for (size_t i = 0; i < values.size(); i++) convertVoxel(values[i], voxels[i]);
+		}
+		else if (method == CONVERT_SIMD)
+		{
+			convertVoxels(&values.front(), &voxels.front(), values.size());
+		}
+		else
+		{
+			const int blocks = int((values.size() + BLOCK - 1) / BLOCK);
+			ThreadPool::instance().parallelFor(blocks, [&](int block)
+			{
+				const size_t begin = size_t(block) * BLOCK;
+				convertVoxels(&values[begin], &voxels[begin], std::min<size_t>(BLOCK, values.size() - begin));
+			});
+		}
+	}
+
+	template<typename T>
+	bool benchmarkConversion(const char *target, const std::vector<unsigned short> &values, int n, int frames, std::ostream &json, bool &first)
+	{
+		std::vector<T> reference(values.size());
+		convert(CONVERT_SCALAR, values, reference);
+
+		const ConversionMethod methods[] = { CONVERT_SCALAR, CONVERT_SIMD, CONVERT_PARALLEL };
+
+		for (int m = 0; m < 3; m++)
+		{
+			std::vector<T> voxels(values.size());
+			std::vector<double> times;
+
+			for (int frame = 0; frame < frames; frame++)
+			{
+				const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				convert(methods[m], values, voxels);
+				times.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+			}
+
+			if (voxels != reference)
+			{
+				std::cerr << "+ Error: " << conversionName(methods[m]) << " conversion to " << target << " differs from the scalar one" << std::endl;
+				return false;
+			}
+
+			std::sort(times.begin(), times.end());
+			const double median = times[times.size() / 2];
+			const double voxelsPerSecond = median > 0.0 ? values.size() / (median / 1000.0) : 0.0;
+			const double bandwidth = voxelsPerSecond * (sizeof(unsigned short) + sizeof(T)) / 1.0e9;
+
+			std::cerr << "conversion " << n << "^3 to " << target << " " << conversionName(methods[m]) << ": " << median << " ms" << std::endl;
+
+			json << (first ? "" : ",") << std::endl
+				<< "    { \"conversion\": \"" << target << "\", \"size\": " << n << ", \"method\": \"" << conversionName(methods[m])
+				<< "\", \"msMin\": " << times.front() << ", \"msMedian\": " << median
+				<< ", \"voxelsPerSecond\": " << voxelsPerSecond << ", \"bandwidthGBs\": " << bandwidth << " }";
+			first = false;
+		}
+
+		return true;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Options
+	//---------------------------------------------------------------------------------------------
+
+	const char* storageName(Volume::Storage storage)
+	{
+		switch (storage)
+		{
+			case Volume::STORAGE_FLOAT:		return "float";
+			case Volume::STORAGE_UINT16:	return "uint16";
+			case Volume::STORAGE_UINT8:		return "uint8";
+		}
+		return "";
+	}
+
+	const char* upsamplingName(Volume::Upsampling upsampling)
+	{
+		switch (upsampling)
+		{
+			case Volume::UPSAMPLE_RAYS:		return "rays";
+			case Volume::UPSAMPLE_BILINEAR:	return "bilinear";
+			case Volume::UPSAMPLE_BICUBIC:	return "bicubic";
+		}
+		return "";
+	}
+
+	int voxelBytes(Volume::Storage storage)
+	{
+		switch (storage)
+		{
+			case Volume::STORAGE_FLOAT:		return 4;
+			case Volume::STORAGE_UINT16:	return 2;
+			case Volume::STORAGE_UINT8:		return 1;
+		}
+		return 0;
+	}
+
+	// comma separated list of positive integers
+	bool parseList(const std::string &text, std::vector<int> &values)
+	{
+		values.clear();
+		std::stringstream stream(text);
+		std::string item;
+
+		while (std::getline(stream, item, ','))
+		{
+			char *end = 0;
+			const long value = strtol(item.c_str(), &end, 10);
+			if (end == item.c_str() || *end != '\0' || value <= 0) return false;
+			values.push_back(int(value));
+		}
+
+		return !values.empty();
+	}
+
+	bool parseFloat(const std::string &text, float &value)
+	{
+		char *end = 0;
+		const double parsed = strtod(text.c_str(), &end);
+		if (end == text.c_str() || *end != '\0') return false;
+
+		value = float(parsed);
+		return true;
+	}
+
+	void printUsage()
+	{
+		std::cout << "usage: Benchmark [options]" << std::endl
+			<< std::endl
+			<< "  --sizes N,N,...                     edge lengths of the volumes (64,128,256)" << std::endl
+			<< "  --samples N,N,...                   sample distances (1,2,4)" << std::endl
+			<< "  --scales N,N,...                    scale factors (1,2)" << std::endl
+			<< "  --frames N                          timed frames per configuration (5)" << std::endl
+			<< "  --storage float|uint16|uint8        voxel storage (uint16)" << std::endl
+			<< "  --layout linear|bricked             voxel layout (linear)" << std::endl
+			<< "  --upsampling rays|bilinear|bicubic  how scaled images are produced (rays)" << std::endl
+			<< "  --traversal auto|ray|slice|packet   volume traversal (auto)" << std::endl
+			<< "  --termination T                     opacity ending alpha compositing rays (0.99)" << std::endl
+			<< "  --column-tables                     serve unscaled MIP, average and first hit from column tables" << std::endl
+			<< "  --no-skipping                       disable empty-space skipping" << std::endl
+			<< "  --lod                               render coarse sample distances from the volume pyramid" << std::endl
+			<< "  --no-simd                           use the scalar code even if the CPU has AVX2" << std::endl
+			<< "  --conversion                        time the conversion of the file values instead of rendering" << std::endl
+			<< "  --output FILE                       write the JSON to FILE instead of stdout" << std::endl;
+	}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+
+	std::vector<int> sizes, sampleDistances, scales;
+	sizes.push_back(64); sizes.push_back(128); sizes.push_back(256);
+	sampleDistances.push_back(1); sampleDistances.push_back(2); sampleDistances.push_back(4);
+	scales.push_back(1); scales.push_back(2);
+
+	int frames = 5;
+	Volume::Storage storage = Volume::STORAGE_UINT16;
+	Volume::Layout layout = Volume::LAYOUT_LINEAR;
+	Volume::Upsampling upsampling = Volume::UPSAMPLE_RAYS;
+	Volume::Traversal traversal = Volume::TRAVERSAL_AUTO;
+	float threshold = 0.99f;
+	bool skipping = true;
+	bool columnTables = false;
+	bool levels = false;
+	bool conversion = false;
+	std::string output;
+
+	// parse options
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string option = argv[i];
+		const std::string argument = (i + 1 < argc) ? argv[i + 1] : "";
+		bool valid = true;
+
+		if (option == "--no-skipping")
+		{
+			skipping = false;
+			continue;
+		}
+		else if (option == "--column-tables")
+		{
+			columnTables = true;
+			continue;
+		}
+		else if (option == "--lod")
+		{
+			levels = true;
+			continue;
+		}
+		else if (option == "--conversion")
+		{
+			conversion = true;
+			continue;
+		}
+		else if (option == "--no-simd")
+		{
+			setAvx2Enabled(false);
+			continue;
+		}
+		else if (option == "--sizes") valid = parseList(argument, sizes);
+		else if (option == "--samples") valid = parseList(argument, sampleDistances);
+		else if (option == "--scales") valid = parseList(argument, scales);
+		else if (option == "--frames")
+		{
+			std::vector<int> values;
+			valid = parseList(argument, values) && values.size() == 1;
+			if (valid) frames = values[0];
+		}
+		else if (option == "--storage")
+		{
+			if (argument == "float") storage = Volume::STORAGE_FLOAT;
+			else if (argument == "uint16") storage = Volume::STORAGE_UINT16;
+			else if (argument == "uint8") storage = Volume::STORAGE_UINT8;
+			else valid = false;
+		}
+		else if (option == "--layout")
+		{
+			if (argument == "linear") layout = Volume::LAYOUT_LINEAR;
+			else if (argument == "bricked") layout = Volume::LAYOUT_BRICKED;
+			else valid = false;
+		}
+		else if (option == "--upsampling")
+		{
+			if (argument == "rays") upsampling = Volume::UPSAMPLE_RAYS;
+			else if (argument == "bilinear") upsampling = Volume::UPSAMPLE_BILINEAR;
+			else if (argument == "bicubic") upsampling = Volume::UPSAMPLE_BICUBIC;
+			else valid = false;
+		}
+		else if (option == "--traversal")
+		{
+			if (argument == "auto") traversal = Volume::TRAVERSAL_AUTO;
+			else if (argument == "ray") traversal = Volume::RAY_MAJOR;
+			else if (argument == "slice") traversal = Volume::SLICE_MAJOR;
+			else if (argument == "packet") traversal = Volume::RAY_PACKETS;
+			else valid = false;
+		}
+		else if (option == "--termination") valid = parseFloat(argument, threshold) && threshold > 0.0f;
+		else if (option == "--output")
+		{
+			output = argument;
+			valid = !output.empty();
+		}
+		else
+		{
+			std::cerr << "+ Unknown option: " << option << std::endl;
+			printUsage();
+			return 1;
+		}
+
+		if (!valid)
+		{
+			std::cerr << "+ Invalid value for " << option << ": " << argument << std::endl;
+			return 1;
+		}
+
+		i++;
+	}
+
+	// run benchmark; progress goes to stderr, so that stdout only carries the JSON
+
+	std::ostringstream json;
+	json << "{" << std::endl
+		<< "  \"threads\": " << ThreadPool::instance().numThreads() << "," << std::endl
+		<< "  \"storage\": \"" << storageName(storage) << "\"," << std::endl
+		<< "  \"layout\": \"" << (layout == Volume::LAYOUT_BRICKED ? "bricked" : "linear") << "\"," << std::endl
+		<< "  \"upsampling\": \"" << upsamplingName(upsampling) << "\"," << std::endl
+		<< "  \"traversal\": \"" << traversalName(traversal) << "\"," << std::endl
+		<< "  \"terminationThreshold\": " << threshold << "," << std::endl
+		<< "  \"emptySpaceSkipping\": " << (skipping ? "true" : "false") << "," << std::endl
+		<< "  \"columnTables\": " << (columnTables ? "true" : "false") << "," << std::endl
+		<< "  \"levelOfDetail\": " << (levels ? "true" : "false") << "," << std::endl
+		<< "  \"avx2\": " << (useAvx2() ? "true" : "false") << "," << std::endl
+		<< "  \"frames\": " << frames << "," << std::endl
+		<< "  \"results\": [";
+
+	const Volume::RenderMode modes[] = { Volume::MIP, Volume::FIRST_HIT, Volume::AVERAGE, Volume::ALPHA_COMPOSITING };
+	const Dataset datasets[] = { SPHERE, NOISE, PHANTOM };
+	bool first = true;
+
+	for (size_t s = 0; s < sizes.size() && conversion; s++)
+	{
+		const std::vector<unsigned short> values = generateVolume(NOISE, sizes[s]);
+
+		if (!benchmarkConversion<float>("float", values, sizes[s], frames, json, first) ||
+			!benchmarkConversion<unsigned char>("uint8", values, sizes[s], frames, json, first))
+		{
+			return 1;
+		}
+	}
+
+	for (size_t s = 0; s < sizes.size() && !conversion; s++)
+	{
+		for (int d = 0; d < 3; d++)
+		{
+			const int n = sizes[s];
+			const Dataset dataset = datasets[d];
+
+			Volume volume;
+			volume.setStorage(storage);
+			volume.setLayout(layout);
+			volume.setEmptySpaceSkipping(skipping);
+			volume.setColumnTables(columnTables);
+			volume.setLevelOfDetail(levels);
+			volume.setUpsampling(upsampling);
+			volume.setTraversal(traversal);
+			volume.setTransparency(0.1f);
+			volume.setTerminationThreshold(threshold);
+
+			if (!volume.loadFromData(n, n, n, generateVolume(dataset, n)))
+			{
+				return 1;
+			}
+
+			for (int m = 0; m < 4; m++)
+			{
+				for (size_t k = 0; k < sampleDistances.size(); k++)
+				{
+					for (size_t f = 0; f < scales.size(); f++)
+					{
+						setMode(volume, modes[m]);
+						volume.setSampleDistance(sampleDistances[k]);
+						volume.setScaleFactor(scales[f]);
+
+						// warm up caches and threads
+						volume.rayCasting2();
+
+						std::vector<double> times;
+						long long samples = 0;
+						long long skipped = 0;
+						double rayLength = 0.0;
+						int level = 0;
+
+						for (int frame = 0; frame < frames; frame++)
+						{
+							volume.rayCasting2();
+							const Volume::RenderStats &stats = volume.renderStats();
+							times.push_back(stats.milliseconds);
+							samples = stats.samples;
+							skipped = stats.skippedSamples;
+							rayLength = stats.averageRayLength;
+							level = stats.level;
+						}
+
+						std::sort(times.begin(), times.end());
+						double mean = 0.0;
+						for (size_t t = 0; t < times.size(); t++) mean += times[t];
+						mean /= times.size();
+						const double median = times[times.size() / 2];
+
+						const double samplesPerSecond = median > 0.0 ? samples / (median / 1000.0) : 0.0;
+						const int voxelsPerSample = (scales[f] > 1 && upsampling == Volume::UPSAMPLE_RAYS) ? 8 : 1;
+						const double bandwidth = samplesPerSecond * voxelsPerSample * voxelBytes(storage) / 1.0e9;
+
+						std::cerr << datasetName(dataset) << " " << n << "^3 " << modeName(modes[m])
+							<< " samples " << sampleDistances[k] << " scale " << scales[f] << ": "
+							<< median << " ms" << std::endl;
+
+						json << (first ? "" : ",") << std::endl
+							<< "    { \"dataset\": \"" << datasetName(dataset) << "\", \"size\": " << n
+							<< ", \"mode\": \"" << modeName(modes[m]) << "\", \"sampleDistance\": " << sampleDistances[k]
+							<< ", \"scaleFactor\": " << scales[f] << ", \"level\": " << level
+							<< ", \"msMin\": " << times.front() << ", \"msMedian\": " << median << ", \"msMean\": " << mean
+							<< ", \"samples\": " << samples << ", \"skippedSamples\": " << skipped << ", \"averageRayLength\": " << rayLength
+							<< ", \"samplesPerSecond\": " << samplesPerSecond << ", \"bandwidthGBs\": " << bandwidth << " }";
+						first = false;
+					}
+				}
+			}
+		}
+	}
+
+	json << std::endl << "  ]" << std::endl << "}" << std::endl;
+
+	// write results
+
+	if (output.empty())
+	{
+		std::cout << json.str();
+	}
+	else
+	{
+		std::ofstream file(output.c_str());
+		file << json.str();
+		if (!file)
+		{
+			std::cerr << "+ Error writing results: " << output << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+
+}
@@ -0,0 +1,322 @@
+#include "BrickCache.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// BrickCache
+//-------------------------------------------------------------------------------------------------
+
+BrickCache::BrickCache()
+	: m_File(0), m_DataOffset(0), m_Width(0), m_Height(0), m_Depth(0), m_Layout(1, 1, 1), m_Budget(1LL << 30), m_Resident(0), m_Loaded(0)
+{
+}
+
+BrickCache::~BrickCache()
+{
+	close();
+}
+
+bool BrickCache::open(const std::string &filename, const int width, const int height, const int depth, const long long dataOffset)
+{
+	// the file has to hold every voxel of its dimensions
+	if (!openFile(filename, width, height, depth, dataOffset + (long long)width * height * depth * sizeof(unsigned short)))
+	{
+		return false;
+	}
+
+	m_DataOffset = dataOffset;
+	return true;
+}
+
+bool BrickCache::open(const std::string &filename, const BrickFileHeader &header)
+{
+	// the file has to hold every brick of its index
+	if (!openFile(filename, header.width, header.height, header.depth, header.offsets.back()))
+	{
+		return false;
+	}
+
+	m_Offsets = header.offsets;
+	return true;
+}
+
+bool BrickCache::openFile(const std::string &filename, const int width, const int height, const int depth, const long long size)
+{
+	close();
+
+	fopen_s(&m_File, filename.c_str(), "rb");
+	if (!m_File)
+	{
+		std::cerr << "+ Error opening file: " << filename << std::endl;
+		return false;
+	}
+
+	if (fileSize(m_File) < size)
+	{
+		std::cerr << "+ Error opening file: " << filename << std::endl;
+		std::cerr << "File is smaller than its dimensions" << std::endl;
+		close();
+		return false;
+	}
+
+	m_DataOffset = 0;
+	m_Width = width;
+	m_Height = height;
+	m_Depth = depth;
+	m_Layout = BrickLayout(width, height, depth);
+
+	const int bricks = m_Layout.bricksX() * m_Layout.bricksY() * m_Layout.bricksZ();
+	m_Bricks.resize(bricks);
+	m_Table.assign(bricks, 0);
+	m_LruPosition.resize(bricks);
+	m_Pins.assign(m_Layout.bricksZ(), 0);
+
+	return true;
+}
+
+void BrickCache::close()
+{
+	if (m_File) fclose(m_File);
+	m_File = 0;
+
+	m_Offsets.clear();
+	m_Compressed.clear();
+	m_Bricks.clear();
+	m_Table.clear();
+	m_Lru.clear();
+	m_LruPosition.clear();
+	m_Pins.clear();
+	m_Resident = 0;
+	m_Loaded = 0;
+}
+
+const bool BrickCache::isOpen() const
+{
+	return m_File != 0;
+}
+
+void BrickCache::swap(BrickCache &other)
+{
+	// the brick table points into the brick vectors and the LRU positions into the list, and
+	// both stay valid when the containers are swapped
+	std::swap(m_File, other.m_File);
+	std::swap(m_DataOffset, other.m_DataOffset);
+	std::swap(m_Width, other.m_Width);
+	std::swap(m_Height, other.m_Height);
+	std::swap(m_Depth, other.m_Depth);
+	m_Offsets.swap(other.m_Offsets);
+	m_Compressed.swap(other.m_Compressed);
+	std::swap(m_Layout, other.m_Layout);
+	std::swap(m_Budget, other.m_Budget);
+	m_Bricks.swap(other.m_Bricks);
+	m_Table.swap(other.m_Table);
+	m_Lru.swap(other.m_Lru);
+	m_LruPosition.swap(other.m_LruPosition);
+	m_Pins.swap(other.m_Pins);
+	std::swap(m_Resident, other.m_Resident);
+	m_Slice.swap(other.m_Slice);
+	std::swap(m_Loaded, other.m_Loaded);
+}
+
+void BrickCache::setBudget(const long long bytes)
+{
+	m_Budget = bytes;
+}
+
+const long long BrickCache::budget() const
+{
+	return m_Budget;
+}
+
+const int BrickCache::slabs() const
+{
+	return m_Layout.bricksZ();
+}
+
+void BrickCache::pin(const int slab)
+{
+	// pinned first, so that making room does not evict bricks of this slab
+	m_Pins[slab]++;
+	loadSlab(slab);
+
+	// the bricks of the slab become the most recently used ones
+	const int first = slab * m_Layout.bricksX() * m_Layout.bricksY();
+	const int last = first + m_Layout.bricksX() * m_Layout.bricksY();
+	for (int brick = first; brick < last; brick++)
+	{
+		m_Lru.splice(m_Lru.begin(), m_Lru, m_LruPosition[brick]);
+	}
+}
+
+void BrickCache::unpin(const int slab)
+{
+	m_Pins[slab]--;
+}
+
+const unsigned short *const *BrickCache::bricks() const
+{
+	return &m_Table.front();
+}
+
+const unsigned short BrickCache::voxel(const int x, const int y, const int z) const
+{
+	const unsigned short *brick = m_Table[m_Layout.brick(x, y, z)];
+	if (brick) return brick[m_Layout.offset(x, y, z)];
+
+	if (!m_Offsets.empty())
+	{
+		// the whole brick is read and decompressed for the voxel
+		const int number = m_Layout.brick(x, y, z);
+		std::vector<unsigned char> data(size_t(m_Offsets[number + 1] - m_Offsets[number]));
+		std::vector<unsigned short> voxels(BrickLayout::BRICK_VOXELS);
+
+		const bool valid = seekFile(m_File, m_Offsets[number], SEEK_SET) == 0 &&
+			fread(&data.front(), 1, data.size(), m_File) == data.size() &&
+			decompressBrick(&data.front(), data.size(), &voxels.front());
+
+		return valid ? voxels[m_Layout.offset(x, y, z)] : 0;
+	}
+
+	unsigned short value = 0;
+	const long long index = x + (long long)y * m_Width + (long long)z * m_Width * m_Height;
+	if (seekFile(m_File, m_DataOffset + index * sizeof(unsigned short), SEEK_SET) == 0)
+	{
+		fread(&value, sizeof(unsigned short), 1, m_File);
+	}
+	return value;
+}
+
+const long long BrickCache::bricksLoaded() const
+{
+	return m_Loaded;
+}
+
+void BrickCache::loadSlab(const int slab)
+{
+	const int bricksX = m_Layout.bricksX();
+	const int bricksY = m_Layout.bricksY();
+	const int first = slab * bricksX * bricksY;
+
+	std::vector<int> missing;
+	for (int brick = first; brick < first + bricksX * bricksY; brick++)
+	{
+		if (!m_Table[brick]) missing.push_back(brick);
+	}
+
+	if (missing.empty()) return;
+
+	evictFor(int(missing.size()));
+
+	for (size_t i = 0; i < missing.size(); i++)
+	{
+		const int brick = missing[i];
+		m_Bricks[brick].assign(BrickLayout::BRICK_VOXELS, 0);
+		m_Table[brick] = &m_Bricks[brick].front();
+		m_Lru.push_front(brick);
+		m_LruPosition[brick] = m_Lru.begin();
+	}
+
+	m_Resident += int(missing.size());
+	m_Loaded += int(missing.size());
+
+	if (!m_Offsets.empty())
+	{
+		decompressSlab(first, missing);
+		return;
+	}
+
+	// the slices of the slab are one contiguous range of the file; each is read as a whole
+	// and its rows are copied into the missing bricks
+	const long long slice = (long long)m_Width * m_Height;
+	m_Slice.resize(size_t(slice));
+
+	const int z0 = slab * BrickLayout::BRICK;
+	const int z1 = std::min(z0 + BrickLayout::BRICK, m_Depth);
+
+	for (int z = z0; z < z1; z++)
+	{
+		if (seekFile(m_File, m_DataOffset + z * slice * sizeof(unsigned short), SEEK_SET) != 0 ||
+			fread(&m_Slice.front(), sizeof(unsigned short), size_t(slice), m_File) != size_t(slice))
+		{
+			std::cerr << "+ Error reading slice " << z << " of a streamed volume" << std::endl;
+			std::fill(m_Slice.begin(), m_Slice.end(), (unsigned short)0);
+		}
+
+		for (size_t i = 0; i < missing.size(); i++)
+		{
+			const int brickX = (missing[i] - first) % bricksX;
+			const int brickY = (missing[i] - first) / bricksX;
+			const int x0 = brickX * BrickLayout::BRICK;
+			const int y0 = brickY * BrickLayout::BRICK;
+			const int x1 = std::min(x0 + BrickLayout::BRICK, m_Width);
+			const int y1 = std::min(y0 + BrickLayout::BRICK, m_Height);
+
+			unsigned short *brick = &m_Bricks[missing[i]].front();
+			for (int y = y0; y < y1; y++)
+			{
+				memcpy(brick + m_Layout.offset(x0, y, z), &m_Slice[size_t(y) * m_Width + x0], (x1 - x0) * sizeof(unsigned short));
+			}
+		}
+	}
+}
+
+void BrickCache::decompressSlab(const int first, const std::vector<int> &missing)
+{
+	// the compressed bricks of a slab are one contiguous range of the file; it is read as a
+	// whole and the missing bricks are decompressed on all threads
+	const int last = first + m_Layout.bricksX() * m_Layout.bricksY();
+	const long long begin = m_Offsets[first];
+	m_Compressed.resize(size_t(m_Offsets[last] - begin));
+
+	if (seekFile(m_File, begin, SEEK_SET) != 0 ||
+		fread(&m_Compressed.front(), 1, m_Compressed.size(), m_File) != m_Compressed.size())
+	{
+		std::cerr << "+ Error reading slab " << first / (last - first) << " of a streamed volume" << std::endl;
+		return;
+	}
+
+	std::atomic<bool> broken(false);
+
+	ThreadPool::instance().parallelFor(int(missing.size()), [&](int i)
+	{
+		const int brick = missing[i];
+		unsigned short *voxels = &m_Bricks[brick].front();
+
+		if (!decompressBrick(&m_Compressed[size_t(m_Offsets[brick] - begin)], size_t(m_Offsets[brick + 1] - m_Offsets[brick]), voxels))
+		{
+			std::fill(voxels, voxels + BrickLayout::BRICK_VOXELS, (unsigned short)0);
+			broken = true;
+		}
+	});
+
+	if (broken)
+	{
+		std::cerr << "+ Error decompressing slab " << first / (last - first) << " of a streamed volume" << std::endl;
+	}
+}
+
+void BrickCache::evictFor(const int bricks)
+{
+	const long long capacity = m_Budget / (BrickLayout::BRICK_VOXELS * (long long)sizeof(unsigned short));
+	const int bricksPerSlab = m_Layout.bricksX() * m_Layout.bricksY();
+
+	// least recently used bricks first, skipping those of pinned slabs
+	std::list<int>::iterator candidate = m_Lru.end();
+	while (m_Resident + bricks > capacity && candidate != m_Lru.begin())
+	{
+		--candidate;
+		const int brick = *candidate;
+		if (m_Pins[brick / bricksPerSlab] > 0) continue;
+
+		candidate = m_Lru.erase(candidate);
+		std::vector<unsigned short>().swap(m_Bricks[brick]);
+		m_Table[brick] = 0;
+		m_Resident--;
+	}
+}
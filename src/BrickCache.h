@@ -0,0 +1,100 @@
+#pragma once
+
+#include "VolumeSampler.h"
+#include "BrickFile.h"
+
+#include <vector>
+#include <list>
+#include <string>
+#include <stdio.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// BrickCache
+//-------------------------------------------------------------------------------------------------
+
+// 16bit voxels of a raw volume file which may be larger than the memory, kept in bricks of
+// BrickLayout. Bricks are paged in from disk by slabs, the bricks sharing one brick z, as the
+// voxels of a slab are one contiguous range of the file. Bricks of unpinned slabs are evicted
+// least recently used first once the cache holds the budget. Brick files are paged in the same
+// way; the compressed bricks of a slab are read at once and decompressed in parallel.
+//
+// pin() and unpin() must not run concurrently with each other or with readers of the brick
+// table; the ray casters call them between their parallel sections.
+
+class BrickCache
+{
+
+	public:
+
+		BrickCache();
+		~BrickCache();
+
+		// dataOffset is the size of the file header in bytes; voxels follow x fastest
+		bool					open(const std::string &filename, const int width, const int height, const int depth, const long long dataOffset);
+
+		// brick file with its header and brick index already read
+		bool					open(const std::string &filename, const BrickFileHeader &header);
+		void					close();
+
+		const bool				isOpen() const;
+
+		// exchanges the files and bricks of both caches, budgets included
+		void					swap(BrickCache &other);
+
+		// memory for bricks in bytes; pinned slabs may exceed it
+		void					setBudget(const long long bytes);
+		const long long			budget() const;
+
+		// SLABS
+
+		const int				slabs() const;
+
+		// pages in the missing bricks of the slab and keeps them until the last unpin()
+		void					pin(const int slab);
+		void					unpin(const int slab);
+
+		// one pointer per brick in BrickLayout order, null while the brick is not in memory
+		const unsigned short *const	*bricks() const;
+
+		// single voxel, read from the file if its brick is not in memory
+		const unsigned short	voxel(const int x, const int y, const int z) const;
+
+		// STATISTICS
+
+		// bricks read from the file since open()
+		const long long			bricksLoaded() const;
+
+	private:
+
+		bool					openFile(const std::string &filename, const int width, const int height, const int depth, const long long size);
+
+		void					loadSlab(const int slab);
+		void					decompressSlab(const int first, const std::vector<int> &missing);
+		void					evictFor(const int bricks);
+
+		FILE								*m_File;
+		long long							m_DataOffset;
+		int									m_Width;
+		int									m_Height;
+		int									m_Depth;
+
+		// file offsets of the compressed bricks and their end; empty for raw volume files
+		std::vector<long long>				m_Offsets;
+		std::vector<unsigned char>			m_Compressed;
+
+		BrickLayout							m_Layout;
+		long long							m_Budget;
+
+		// brick data, table and least recently used order, most recent first
+		std::vector<std::vector<unsigned short> >	m_Bricks;
+		std::vector<const unsigned short*>	m_Table;
+		std::list<int>						m_Lru;
+		std::vector<std::list<int>::iterator>	m_LruPosition;
+		std::vector<int>					m_Pins;
+		int									m_Resident;
+
+		std::vector<unsigned short>			m_Slice;
+		long long							m_Loaded;
+
+};
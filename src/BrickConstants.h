@@ -0,0 +1,18 @@
+#pragma once
+
+
+//-------------------------------------------------------------------------------------------------
+// BrickConstants
+//-------------------------------------------------------------------------------------------------
+
+// Size of the bricks of BrickLayout. Kept apart from VolumeSampler.h and without any function,
+// so that the translation units compiled for AVX2 can include it: an inline function compiled
+// there could be the copy the linker keeps for callers on CPUs without AVX2.
+
+struct BrickConstants
+{
+	static const int		BRICK_SHIFT = 5;
+	static const int		BRICK = 1 << BRICK_SHIFT;
+	static const int		BRICK_MASK = BRICK - 1;
+	static const int		BRICK_VOXELS = BRICK * BRICK * BRICK;
+};
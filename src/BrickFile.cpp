@@ -0,0 +1,246 @@
+#include "BrickFile.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <string.h>
+#include <climits>
+
+
+//-------------------------------------------------------------------------------------------------
+// Brick File Header
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	const char MAGIC[4] = { 'B', 'V', 'O', 'L' };
+
+	// magic, version, dimensions and brick edge
+	const int FIXED_HEADER_BYTES = 6 * sizeof(unsigned int);
+
+	// the header is stored little endian whatever the byte order of the host
+	void storeLittleEndian(unsigned long long value, const int bytes, unsigned char *data)
+	{
+		for (int i = 0; i < bytes; i++)
+		{
+			data[i] = (unsigned char)(value >> (8 * i));
+		}
+	}
+
+	unsigned long long loadLittleEndian(const unsigned char *data, const int bytes)
+	{
+		unsigned long long value = 0;
+		for (int i = 0; i < bytes; i++)
+		{
+			value |= (unsigned long long)data[i] << (8 * i);
+		}
+		return value;
+	}
+}
+
+const long long brickFileHeaderSize(const int bricks)
+{
+	return FIXED_HEADER_BYTES + (bricks + 1LL) * sizeof(long long);
+}
+
+bool isBrickFile(const std::string &filename)
+{
+	FILE *fp = NULL;
+	fopen_s(&fp, filename.c_str(), "rb");
+	if (!fp) return false;
+
+	char magic[sizeof(MAGIC)];
+	const bool found = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+	fclose(fp);
+
+	return found;
+}
+
+bool readBrickFileHeader(FILE *file, BrickFileHeader &header)
+{
+	unsigned char bytes[FIXED_HEADER_BYTES];
+	if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) return false;
+
+	unsigned int fields[6] = { 0 };
+	for (int i = 1; i < 6; i++)
+	{
+		fields[i] = (unsigned int)loadLittleEndian(bytes + i * sizeof(unsigned int), sizeof(unsigned int));
+	}
+
+	if (memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0 || fields[1] != (unsigned int)BRICK_FILE_VERSION || fields[5] != (unsigned int)BrickLayout::BRICK)
+	{
+		return false;
+	}
+
+	for (int i = 2; i < 5; i++)
+	{
+		if (fields[i] == 0 || fields[i] > (unsigned int)BrickLayout::MAX_DIMENSION) return false;
+	}
+
+	header.width = int(fields[2]);
+	header.height = int(fields[3]);
+	header.depth = int(fields[4]);
+
+	// the brick numbers of BrickLayout are int
+	const BrickLayout layout(header.width, header.height, header.depth);
+	const long long bricks = (long long)layout.bricksX() * layout.bricksY() * layout.bricksZ();
+	if (bricks >= INT_MAX) return false;
+
+	// a damaged header must not allocate an index larger than the whole file
+	const long long position = tellFile(file);
+	const long long size = fileSize(file);
+	if (position < 0 || size < brickFileHeaderSize(int(bricks)) || seekFile(file, position, SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> index(size_t(bricks + 1) * sizeof(long long));
+	if (fread(&index.front(), 1, index.size(), file) != index.size())
+	{
+		return false;
+	}
+
+	header.offsets.resize(size_t(bricks + 1));
+	for (size_t i = 0; i < header.offsets.size(); i++)
+	{
+		header.offsets[i] = (long long)loadLittleEndian(&index[i * sizeof(long long)], sizeof(long long));
+	}
+
+	// bricks follow the index without gaps, and none is empty
+	if (header.offsets[0] != brickFileHeaderSize(int(bricks))) return false;
+	for (size_t i = 1; i < header.offsets.size(); i++)
+	{
+		if (header.offsets[i] <= header.offsets[i - 1]) return false;
+	}
+
+	return header.offsets.back() <= size;
+}
+
+bool writeBrickFileHeader(FILE *file, const BrickFileHeader &header)
+{
+	const unsigned int fields[6] = { 0, BRICK_FILE_VERSION, (unsigned int)header.width, (unsigned int)header.height, (unsigned int)header.depth, BrickLayout::BRICK };
+
+	unsigned char bytes[FIXED_HEADER_BYTES];
+	memcpy(bytes, MAGIC, sizeof(MAGIC));
+	for (int i = 1; i < 6; i++)
+	{
+		storeLittleEndian(fields[i], sizeof(unsigned int), bytes + i * sizeof(unsigned int));
+	}
+
+	std::vector<unsigned char> index(header.offsets.size() * sizeof(long long));
+	for (size_t i = 0; i < header.offsets.size(); i++)
+	{
+		storeLittleEndian((unsigned long long)header.offsets[i], sizeof(long long), &index[i * sizeof(long long)]);
+	}
+
+	return fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes) &&
+		fwrite(&index.front(), 1, index.size(), file) == index.size();
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Brick Codec
+//-------------------------------------------------------------------------------------------------
+
+void compressBrick(const unsigned short *voxels, std::vector<unsigned char> &data)
+{
+	data.clear();
+
+	const unsigned short lowest = *std::min_element(voxels, voxels + BrickLayout::BRICK_VOXELS);
+	const unsigned short highest = *std::max_element(voxels, voxels + BrickLayout::BRICK_VOXELS);
+
+	if (lowest == highest)
+	{
+		data.push_back(BRICK_CONSTANT);
+		data.push_back((unsigned char)(lowest & 0xFF));
+		data.push_back((unsigned char)(lowest >> 8));
+		return;
+	}
+
+	data.push_back(BRICK_PACKED);
+
+	for (int row = 0; row < BrickLayout::BRICK_VOXELS; row += BrickLayout::BRICK)
+	{
+		const unsigned short *values = voxels + row;
+		const unsigned short base = *std::min_element(values, values + BrickLayout::BRICK);
+		const unsigned int range = *std::max_element(values, values + BrickLayout::BRICK) - base;
+
+		int bits = 0;
+		while ((range >> bits) != 0) bits++;
+
+		data.push_back((unsigned char)(base & 0xFF));
+		data.push_back((unsigned char)(base >> 8));
+		data.push_back((unsigned char)bits);
+
+		// least significant bits first; 32 values of any width fill whole bytes
+		unsigned long long buffer = 0;
+		int filled = 0;
+
+		for (int i = 0; i < BrickLayout::BRICK; i++)
+		{
+			buffer |= (unsigned long long)(values[i] - base) << filled;
+			filled += bits;
+
+			while (filled >= 8)
+			{
+				data.push_back((unsigned char)(buffer & 0xFF));
+				buffer >>= 8;
+				filled -= 8;
+			}
+		}
+	}
+}
+
+bool decompressBrick(const unsigned char *data, const size_t size, unsigned short *voxels)
+{
+	if (size == 0) return false;
+
+	if (data[0] == BRICK_CONSTANT)
+	{
+		if (size != 3) return false;
+
+		std::fill(voxels, voxels + BrickLayout::BRICK_VOXELS, (unsigned short)(data[1] | (data[2] << 8)));
+		return true;
+	}
+
+	if (data[0] != BRICK_PACKED) return false;
+
+	size_t position = 1;
+
+	for (int row = 0; row < BrickLayout::BRICK_VOXELS; row += BrickLayout::BRICK)
+	{
+		if (position + 3 > size) return false;
+
+		const unsigned short base = (unsigned short)(data[position] | (data[position + 1] << 8));
+		const int bits = data[position + 2];
+		position += 3;
+
+		unsigned short *values = voxels + row;
+
+		if (bits == 0)
+		{
+			std::fill(values, values + BrickLayout::BRICK, base);
+			continue;
+		}
+
+		if (bits > 16 || position + size_t(4 * bits) > size) return false;
+
+		const unsigned int mask = (1u << bits) - 1;
+		unsigned long long buffer = 0;
+		int filled = 0;
+
+		for (int i = 0; i < BrickLayout::BRICK; i++)
+		{
+			while (filled < bits)
+			{
+				buffer |= (unsigned long long)data[position++] << filled;
+				filled += 8;
+			}
+
+			values[i] = (unsigned short)(base + (buffer & mask));
+			buffer >>= bits;
+			filled -= bits;
+		}
+	}
+
+	return position == size;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "VolumeSampler.h"
+
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// Brick Files
+//-------------------------------------------------------------------------------------------------
+
+// Volumes compressed in bricks of BrickLayout, each of which can be decompressed on its own,
+// usually saved as .bvol files. They start with the header and the brick index, all values
+// little endian:
+//
+//   "BVOL", version, width, height, depth, brick edge      six 32bit values
+//   offsets[bricks + 1]                                    64bit file offsets
+//
+// Brick b is stored in the bytes [offsets[b] .. offsets[b + 1]), in BrickLayout order, and
+// holds the 16bit voxels of the brick including its zero padding. A brick is either
+//
+//   BRICK_CONSTANT, value                                  3 bytes for bricks of one value
+//   BRICK_PACKED, 1024 brick rows of 32 voxels             each row as its 16bit minimum, the
+//                                                          bits per voxel and the differences to
+//                                                          the minimum packed with that many bits
+//
+// Rows of empty space cost 3 bytes and 12bit rows at most 51, so that the codec is lossless
+// and decompresses with shifts and masks only.
+
+const int					BRICK_FILE_VERSION = 1;
+
+enum BrickCoding
+{
+	BRICK_CONSTANT			= 0,
+	BRICK_PACKED			= 1
+};
+
+struct BrickFileHeader
+{
+	int						width;
+	int						height;
+	int						depth;
+	std::vector<long long>	offsets;			// bricks + 1 file offsets
+};
+
+// bytes of the header and the brick index of a volume with that many bricks
+const long long				brickFileHeaderSize(const int bricks);
+
+// true if the file starts like a brick file
+bool						isBrickFile(const std::string &filename);
+
+// reads and checks header and brick index from the start of the file; the index and the
+// bricks it points to have to lie within the file
+bool						readBrickFileHeader(FILE *file, BrickFileHeader &header);
+bool						writeBrickFileHeader(FILE *file, const BrickFileHeader &header);
+
+// the BrickLayout::BRICK_VOXELS voxels of one brick into data, which is replaced
+void						compressBrick(const unsigned short *voxels, std::vector<unsigned char> &data);
+
+// false if the size bytes of data are not exactly one compressed brick
+bool						decompressBrick(const unsigned char *data, const size_t size, unsigned short *voxels);
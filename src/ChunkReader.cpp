@@ -0,0 +1,109 @@
+#include "ChunkReader.h"
+
+#include <algorithm>
+
+
+//-------------------------------------------------------------------------------------------------
+// ChunkReader
+//-------------------------------------------------------------------------------------------------
+
+ChunkReader::ChunkReader(FILE *file, const size_t sliceVoxels, const int depth, const int slicesPerChunk, const int buffers, unsigned short *destination)
+	: m_File(file), m_SliceVoxels(sliceVoxels), m_Depth(depth), m_SlicesPerChunk(slicesPerChunk), m_Destination(destination), m_Done(false), m_Failed(false), m_Stop(false)
+{
+	if (!m_Destination) m_Buffers.resize(buffers);
+	for (int i = 0; i < buffers; i++) m_Free.push_back(i);
+
+	// started last, so that the thread only sees initialised members
+	m_Thread = std::thread(&ChunkReader::readerLoop, this);
+}
+
+ChunkReader::~ChunkReader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_Changed.notify_all();
+
+	// a chunk being read is finished first
+	m_Thread.join();
+}
+
+bool ChunkReader::next(Chunk &chunk)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Changed.wait(lock, [this] { return !m_Ready.empty() || m_Done; });
+	if (m_Ready.empty()) return false;
+
+	chunk = m_Ready.front();
+	m_Ready.pop_front();
+
+	return true;
+}
+
+void ChunkReader::release(const Chunk &chunk)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Free.push_back(chunk.buffer);
+	}
+	m_Changed.notify_all();
+}
+
+const bool ChunkReader::failed()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Failed;
+}
+
+void ChunkReader::readerLoop()
+{
+	for (int zBegin = 0; zBegin < m_Depth; zBegin += m_SlicesPerChunk)
+	{
+		Chunk chunk;
+		chunk.zBegin = zBegin;
+		chunk.slices = std::min(m_SlicesPerChunk, m_Depth - zBegin);
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Changed.wait(lock, [this] { return !m_Free.empty() || m_Stop; });
+			if (m_Stop) break;
+
+			chunk.buffer = m_Free.back();
+			m_Free.pop_back();
+		}
+
+		// the buffers are only allocated when first needed and then reused
+		const size_t count = m_SliceVoxels * chunk.slices;
+		unsigned short *voxels = m_Destination + m_SliceVoxels * zBegin;
+		if (!m_Destination)
+		{
+			m_Buffers[chunk.buffer].resize(m_SliceVoxels * m_SlicesPerChunk);
+			voxels = &m_Buffers[chunk.buffer].front();
+		}
+
+		const bool complete = fread(voxels, sizeof(unsigned short), count, m_File) == count;
+		chunk.voxels = voxels;
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (complete)
+			{
+				m_Ready.push_back(chunk);
+			}
+			else
+			{
+				m_Failed = true;
+			}
+		}
+		m_Changed.notify_all();
+
+		if (!complete) break;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Done = true;
+	}
+	m_Changed.notify_all();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdio.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// ChunkReader
+//-------------------------------------------------------------------------------------------------
+
+// Reads the 16bit slices of a volume file on a thread of its own, a chunk of consecutive
+// slices at a time, while the caller processes the chunks read before. A bounded number of
+// chunk buffers limits how far the reader runs ahead; a chunk's buffer is reused once the
+// caller releases it. The file has to be positioned at the first voxel and is only touched
+// by the reader thread until the reader is destroyed.
+
+class ChunkReader
+{
+
+	public:
+
+		struct Chunk
+		{
+			const unsigned short	*voxels;		// all voxels of the chunk's slices, x fastest
+			int						zBegin;
+			int						slices;
+			int						buffer;
+		};
+
+		// with a destination for all slices, the chunks are read straight into it and the
+		// buffers only limit the read-ahead
+		ChunkReader(FILE *file, const size_t sliceVoxels, const int depth, const int slicesPerChunk, const int buffers, unsigned short *destination = 0);
+		~ChunkReader();
+
+		// CHUNKS
+
+		// waits for the next chunk in file order; false once all chunks were taken or the
+		// file ended early
+		bool					next(Chunk &chunk);
+
+		// hands the buffer of a processed chunk back to the reader
+		void					release(const Chunk &chunk);
+
+		// true if the file ended before the last slice
+		const bool				failed();
+
+	private:
+
+		void					readerLoop();
+
+		FILE								*m_File;
+		size_t								m_SliceVoxels;
+		int									m_Depth;
+		int									m_SlicesPerChunk;
+		unsigned short						*m_Destination;
+
+		std::vector<std::vector<unsigned short> >	m_Buffers;
+
+		std::thread							m_Thread;
+		std::mutex							m_Mutex;
+		std::condition_variable				m_Changed;
+
+		// guarded by m_Mutex
+		std::vector<int>					m_Free;			// buffers the reader may fill
+		std::deque<Chunk>					m_Ready;		// chunks read, in file order
+		bool								m_Done;
+		bool								m_Failed;
+		bool								m_Stop;
+
+};
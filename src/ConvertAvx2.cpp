@@ -0,0 +1,70 @@
+// this translation unit is compiled for AVX2 (/arch:AVX2 in the projects)
+#ifdef __GNUC__
+	#pragma GCC target("avx2")
+#endif
+
+#include "ConvertAvx2.h"
+
+#include <immintrin.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// Voxel Conversion with AVX2
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	// eight values widened to 32bit and clamped to the 12bit range
+	inline __m256i loadClamped(const unsigned short *values)
+	{
+		const __m256i value = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)values));
+		return _mm256_min_epi32(value, _mm256_set1_epi32(4095));
+	}
+
+	// the divisions are exact IEEE divisions as in the scalar code, not multiplications
+	// with the reciprocal, which would round differently
+	inline __m256 normalize(const __m256i clamped)
+	{
+		return _mm256_div_ps(_mm256_cvtepi32_ps(clamped), _mm256_set1_ps(4095.0f));
+	}
+
+	// (clamped * 255 + 2047) / 4095, at least 1 for non-zero values; the numerator has less
+	// than 24bit and no quotient lies close enough below an integer for the float division to
+	// round up to it, so truncating the float quotient gives the integer division
+	inline __m256i rescale(const __m256i clamped)
+	{
+		const __m256i numerator = _mm256_add_epi32(_mm256_mullo_epi32(clamped, _mm256_set1_epi32(255)), _mm256_set1_epi32(2047));
+		const __m256i quotient = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(numerator), _mm256_set1_ps(4095.0f)));
+
+		return _mm256_max_epi32(quotient, _mm256_min_epi32(clamped, _mm256_set1_epi32(1)));
+	}
+}
+
+size_t convertAvx2(const unsigned short *values, float *voxels, size_t count)
+{
+	const size_t groups = count & ~size_t(15);
+
+	for (size_t i = 0; i < groups; i += 16)
+	{
+		_mm256_storeu_ps(voxels + i, normalize(loadClamped(values + i)));
+		_mm256_storeu_ps(voxels + i + 8, normalize(loadClamped(values + i + 8)));
+	}
+
+	return groups;
+}
+
+size_t convertAvx2(const unsigned short *values, unsigned char *voxels, size_t count)
+{
+	const size_t groups = count & ~size_t(15);
+
+	for (size_t i = 0; i < groups; i += 16)
+	{
+		// packing works inside the 128bit lanes, the permutation restores the order
+		const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(rescale(loadClamped(values + i)), rescale(loadClamped(values + i + 8))), 0xD8);
+		const __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+
+		_mm_storeu_si128((__m128i*)(voxels + i), bytes);
+	}
+
+	return groups;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// Voxel Conversion with AVX2
+//-------------------------------------------------------------------------------------------------
+
+// Converts 16 file values per step with the same operations as convertVoxel(), so that both
+// paths give identical voxels. Only call these when useAvx2() is true; they live in their own
+// translation unit which is compiled for AVX2.
+
+// converts the values in groups of 16 and returns how many were converted; the remaining
+// count % 16 values are left to the caller
+size_t convertAvx2(const unsigned short *values, float *voxels, size_t count);
+size_t convertAvx2(const unsigned short *values, unsigned char *voxels, size_t count);
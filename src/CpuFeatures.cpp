@@ -0,0 +1,75 @@
+#include "CpuFeatures.h"
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+
+
+//-------------------------------------------------------------------------------------------------
+// CPU Features
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	void cpuid(int leaf, int subleaf, unsigned int registers[4])
+	{
+#ifdef _MSC_VER
+		int values[4];
+		__cpuidex(values, leaf, subleaf);
+		for (int i = 0; i < 4; i++) registers[i] = (unsigned int)values[i];
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	}
+
+	// extended control register 0, which tells the register states the OS saves
+	unsigned long long xcr0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int low, high;
+		__asm__ volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((unsigned long long)high << 32) | low;
+#endif
+	}
+
+	bool detectAvx2()
+	{
+		unsigned int registers[4];
+
+		cpuid(0, 0, registers);
+		if (registers[0] < 7) return false;
+
+		// OSXSAVE and AVX, then the SSE and AVX register states enabled by the OS
+		cpuid(1, 0, registers);
+		const unsigned int osxsave = 1u << 27;
+		const unsigned int avx = 1u << 28;
+		if ((registers[2] & (osxsave | avx)) != (osxsave | avx)) return false;
+		if ((xcr0() & 0x6) != 0x6) return false;
+
+		cpuid(7, 0, registers);
+		return (registers[1] & (1u << 5)) != 0;
+	}
+
+	// initialised before main(), so that concurrent renderers never race on the detection
+	const bool g_HasAvx2 = detectAvx2();
+	bool g_Avx2Enabled = true;
+}
+
+bool cpuHasAvx2()
+{
+	return g_HasAvx2;
+}
+
+bool useAvx2()
+{
+	return g_HasAvx2 && g_Avx2Enabled;
+}
+
+void setAvx2Enabled(bool enabled)
+{
+	g_Avx2Enabled = enabled;
+}
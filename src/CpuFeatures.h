@@ -0,0 +1,17 @@
+#pragma once
+
+
+//-------------------------------------------------------------------------------------------------
+// CPU Features
+//-------------------------------------------------------------------------------------------------
+
+// Instruction set extensions are detected once at startup. Code paths which need them are
+// compiled into separate translation units and only called when the running CPU (and the
+// operating system, which has to save the wider registers) supports them.
+
+// AVX2 including the OS support for the 256bit registers
+bool cpuHasAvx2();
+
+// whether the AVX2 code paths are used; disabling them allows comparing with the scalar code
+bool useAvx2();
+void setAvx2Enabled(bool enabled);
@@ -0,0 +1,85 @@
+#include "ImageFile.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+
+//-------------------------------------------------------------------------------------------------
+// Image Files
+//-------------------------------------------------------------------------------------------------
+
+bool writePgm(const std::string &filename, const std::vector<float> &pixels, const int width, const int height)
+{
+	if (width <= 0 || height <= 0 || pixels.size() < size_t(width) * size_t(height)) return false;
+
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file) return false;
+
+	file << "P5\n" << width << " " << height << "\n65535\n";
+
+	// PGM starts with the top row, 16bit samples are big-endian
+	std::vector<unsigned char> row(width * 2);
+
+	for (int y = height - 1; y >= 0; y--)
+	{
+		const float *source = &pixels[y * width];
+
+		for (int x = 0; x < width; x++)
+		{
+			const float value = std::max(0.0f, std::min(1.0f, source[x]));
+			const unsigned int sample = (unsigned int)(value * 65535.0f + 0.5f);
+
+			row[2 * x] = (unsigned char)(sample >> 8);
+			row[2 * x + 1] = (unsigned char)(sample & 0xff);
+		}
+
+		file.write((const char*)&row.front(), row.size());
+	}
+
+	return bool(file);
+}
+
+bool writePfm(const std::string &filename, const std::vector<float> &pixels, const int width, const int height)
+{
+	if (width <= 0 || height <= 0 || pixels.size() < size_t(width) * size_t(height)) return false;
+
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file) return false;
+
+	// a negative scale marks little-endian data; PFM rows go from bottom to top like the frame
+	file << "Pf\n" << width << " " << height << "\n-1.0\n";
+
+	const unsigned int probe = 1;
+	const bool littleEndian = *(const unsigned char*)&probe == 1;
+
+	if (littleEndian)
+	{
+		file.write((const char*)&pixels.front(), sizeof(float) * width * height);
+	}
+	else
+	{
+		for (int i = 0; i < width * height; i++)
+		{
+			const unsigned char *bytes = (const unsigned char*)&pixels[i];
+			const char swapped[4] = { (char)bytes[3], (char)bytes[2], (char)bytes[1], (char)bytes[0] };
+			file.write(swapped, 4);
+		}
+	}
+
+	return bool(file);
+}
+
+bool writeImage(const std::string &filename, const std::vector<float> &pixels, const int width, const int height)
+{
+	const size_t dot = filename.find_last_of(".");
+	if (dot == std::string::npos) return false;
+
+	std::string extension = filename.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	if (extension == "pgm") return writePgm(filename, pixels, width, height);
+	if (extension == "pfm") return writePfm(filename, pixels, width, height);
+
+	return false;
+}
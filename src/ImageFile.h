@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+
+//-------------------------------------------------------------------------------------------------
+// Image Files
+//-------------------------------------------------------------------------------------------------
+
+// Writers for rendered grayscale frames. Pixels are FLOAT values in an interval of [0.0 .. 1.0],
+// stored row by row starting with the bottom row, as returned by Volume::rayCasting2().
+
+// binary 16bit PGM (P5), top row first; values are clamped to [0.0 .. 1.0]
+bool writePgm(const std::string &filename, const std::vector<float> &pixels, const int width, const int height);
+
+// grayscale little-endian PFM (Pf), bottom row first; values are written unchanged
+bool writePfm(const std::string &filename, const std::vector<float> &pixels, const int width, const int height);
+
+// chooses the writer from the file extension (.pgm or .pfm)
+bool writeImage(const std::string &filename, const std::vector<float> &pixels, const int width, const int height);
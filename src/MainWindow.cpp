@@ -1,12 +1,13 @@
 #include "MainWindow.h"
 
 #include <QFileDialog>
+#include <QApplication>
 
 #include <QPainter>
 
 
 MainWindow::MainWindow(QWidget *parent)
-	: QMainWindow(parent), m_Volume(0), m_VectorField(0)
+	: QMainWindow(parent), m_Volume(0), m_VectorField(0), m_Mode(Volume::MIP), m_sample(1), m_alpha(1), m_factor(1)
 {
 	m_Ui = new Ui_MainWindow();
 	m_Ui->setupUi(this);
@@ -19,15 +20,15 @@ MainWindow::MainWindow(QWidget *parent)
 	connect(m_Ui->radioAverage, SIGNAL(clicked()), this, SLOT(chooseRenderingTechnique()));
 	connect(m_Ui->renderButton, SIGNAL(clicked()), this, SLOT(startRendering()));
 	connect(m_Ui->sampleSlider, SIGNAL(valueChanged(int)), this, SLOT(setSampleSlider(int)));
-	connect(m_Ui->sampleSlider, SIGNAL(sliderReleased()), this, SLOT(setSampleDistance()));
 	connect(m_Ui->transSlider, SIGNAL(valueChanged(int)), this, SLOT(setTransSlider(int)));
-	connect(m_Ui->transSlider, SIGNAL(sliderReleased()), this, SLOT(setTransAlpha()));
 	connect(m_Ui->scaleSlider, SIGNAL(valueChanged(int)), this, SLOT(setScaleSlider(int)));
-	connect(m_Ui->scaleSlider, SIGNAL(sliderReleased()), this, SLOT(setScaleFactor()));
 }
 
 MainWindow::~MainWindow()
 {
+	// stop rendering before the volume goes away
+	m_Ui->myGLWidget->setVolume(0);
+
 	delete m_Volume;
 	delete m_VectorField;
 	delete m_MultiSet;
@@ -40,10 +41,13 @@ MainWindow::~MainWindow()
 
 void MainWindow::openFileAction()
 {
-	QString filename = QFileDialog::getOpenFileName(this, "Data File", 0, tr("Data Files (*.dat *.gri *.csv)"));
+	QString filename = QFileDialog::getOpenFileName(this, "Data File", 0, tr("Data Files (*.dat *.bvol *.gri *.csv)"));
 
 	if (!filename.isEmpty())
 	{
+		// no frame is requested while the data is replaced
+		success = false;
+
 		// store filename
 		m_FileType.filename = filename;
 		std::string fn = filename.toStdString();
@@ -53,14 +57,18 @@ void MainWindow::openFileAction()
 		m_Ui->labelTop->setText("Loading data ...");
 
 		// load data according to file extension
-		if (fn.substr(fn.find_last_of(".") + 1) == "dat")		// LOAD VOLUME      <----------------------
+		const std::string extension = fn.substr(fn.find_last_of(".") + 1);
+		if (extension == "dat" || extension == "bvol")		// LOAD VOLUME      <----------------------
 		{
 			// create VOLUME
 			m_FileType.type = VOLUME;
 			m_Volume = new Volume();
+			m_Volume->setMemoryMapped(true);
+			m_Volume->setColumnTables(true);
+			m_Volume->setAlphaCache(true);
 
 			// load file
-			success = m_Volume->loadFromFile(filename, m_Ui->progressBar);
+			success = runLoader([&](Progress* progress) { return m_Volume->loadFromFile(filename, progress); });
 
 			if (success) {
 				//m_Volume->setAlphaCompositing();
@@ -75,7 +83,7 @@ void MainWindow::openFileAction()
 			m_VectorField = new VectorField();
 
 			// load file
-			success = m_VectorField->loadFromFile(filename, m_Ui->progressBar);
+			success = runLoader([&](Progress* progress) { return m_VectorField->loadFromFile(filename, progress); });
 		}
 		else if (fn.substr(fn.find_last_of(".") + 1) == "csv")		// LOAD MULTIVARIATE DATA
 		{
@@ -84,10 +92,11 @@ void MainWindow::openFileAction()
 			m_MultiSet = new MultiSet();
 
 			// load file
-			success = m_MultiSet->loadFromFile(filename, m_Ui->progressBar);
+			success = runLoader([&](Progress* progress) { return m_MultiSet->loadFromFile(filename, progress); });
 		}
 
 		m_Ui->progressBar->setEnabled(false);
+		m_Ui->progressBar->setValue(0);
 
 		// status message
 		if (success)
@@ -114,6 +123,34 @@ void MainWindow::openFileAction()
 	}
 }
 
+bool MainWindow::runLoader(const std::function<bool(Progress*)> &load)
+{
+	// the loader runs on its own thread and only updates atomic counters;
+	// the progress bar is refreshed from them at a fixed rate
+	Progress progress;
+	std::atomic<bool> done(false);
+	bool result = false;
+
+	std::thread loader([&]
+	{
+		result = load(&progress);
+		done = true;
+	});
+
+	m_Ui->progressBar->setRange(0, PROGRESS_STEPS);
+
+	while (!done)
+	{
+		m_Ui->progressBar->setValue(int(progress.fraction() * PROGRESS_STEPS));
+		QApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1000 / PROGRESS_FPS));
+	}
+
+	loader.join();
+
+	return result;
+}
+
 void MainWindow::closeAction()
 {
 	close();
@@ -126,26 +163,28 @@ void MainWindow::chooseRenderingTechnique()
 		if (m_Ui->radioMIP->isChecked())
 		{
 			std::cout << "set rendering technique MIP" << std::endl;
-			m_Volume->setMip();
+			m_Mode = Volume::MIP;
 		}
 
 		if (m_Ui->radioFH->isChecked())
 		{
 			std::cout << "set rendering technique first hit" << std::endl;
-			m_Volume->setFirstHit();
+			m_Mode = Volume::FIRST_HIT;
 		}
 
 		if (m_Ui->radioAverage->isChecked())
 		{
 			std::cout << "set rendering technique average" << std::endl;
-			m_Volume->setAverage();
+			m_Mode = Volume::AVERAGE;
 		}
 
 		if (m_Ui->radioAC->isChecked())
 		{
 			std::cout << "set rendering technique alpha compositing" << std::endl;
-			m_Volume->setAlphaCompositing();
+			m_Mode = Volume::ALPHA_COMPOSITING;
 		}
+
+		requestFrame(true);
 	}
 }
 
@@ -153,55 +192,48 @@ void MainWindow::setSampleSlider(int distance)
 {
 	m_sample = distance;
 	m_Ui->sampleTxt->setText(QString::number(distance));
-	QApplication::processEvents();
-}
+	requestFrame(true);
 
-void MainWindow::setSampleDistance()
-{
-	if (success)
-	{
-		std::cout << "set sample distance: " << m_sample << std::endl;
-		m_Volume->setSampleDistance(m_sample);
-	}
+	QApplication::processEvents();
 }
 
 void MainWindow::setTransSlider(int alpha)
 {
 	m_alpha = alpha;
 	m_Ui->transTxt->setText(QString::number((float)m_alpha / 10.f));
-	QApplication::processEvents();
-}
+	requestFrame(true);
 
-void MainWindow::setTransAlpha()
-{
-	if (success)
-	{
-		float a = (float)m_alpha / 10.f;
-		std::cout << "set alph transparence : " << a << std::endl;
-		m_Volume->setTransparency(a);
-	}
+	QApplication::processEvents();
 }
 
 void MainWindow::setScaleSlider(int factor)
 {
 	m_factor = factor;
 	m_Ui->scaleTxt->setText(QString::number(m_factor));
+	requestFrame(true);
+
 	QApplication::processEvents();
 }
 
-void MainWindow::setScaleFactor()
+void MainWindow::startRendering()
 {
 	if (success)
 	{
-		std::cout << "set scale factor : " << m_factor << std::endl;
-		m_Volume->setScaleFactor(m_factor);
+		requestFrame(false);
 	}
 }
 
-void MainWindow::startRendering()
+void MainWindow::requestFrame(bool progressive)
 {
-	if (success)
+	if (success && m_Volume)
 	{
-		m_Ui->myGLWidget->startRendering();
+		RenderWorker::Settings settings;
+		settings.mode = m_Mode;
+		settings.sampleDistance = m_sample;
+		settings.scaleFactor = m_factor;
+		settings.transparency = (float)m_alpha / 10.f;
+		settings.firstLevel = progressive ? Volume::PYRAMID_LEVELS : 0;
+
+		m_Ui->myGLWidget->requestFrame(settings);
 	}
 }
@@ -14,6 +14,11 @@
 #include <QStatusBar>
 #include <QVariant>
 
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
 
 class MainWindow : public QMainWindow
 {
@@ -31,20 +36,27 @@ class MainWindow : public QMainWindow
 		void			closeAction();
 		void			chooseRenderingTechnique();
 		void			setSampleSlider(int distance);
-		void			setSampleDistance();
 		void			startRendering();
 		void			setTransSlider(int alpha);
-		void			setTransAlpha();
 		void			setScaleSlider(int factor);
-		void			setScaleFactor();
 		
 
 	private:
 
+		// runs a file loader on a worker thread while the progress bar follows it
+		bool				runLoader(const std::function<bool(Progress*)> &load);
+
+		// asks the render worker for a frame with the current settings, refined progressively
+		// from the coarsest pyramid level or rendered at full quality at once
+		void				requestFrame(bool progressive);
+
 		// USER INTERFACE ELEMENTS
 
 		Ui_MainWindow						*m_Ui;
 
+		static const int					PROGRESS_FPS = 30;
+		static const int					PROGRESS_STEPS = 1000;
+
 
 		// DATA 
 
@@ -66,6 +78,9 @@ class MainWindow : public QMainWindow
 		MultiSet			*m_MultiSet;					// for Multivariate Data
 
 		bool				success = false;
+
+		// render settings; the volume itself is only changed by the render worker
+		Volume::RenderMode	m_Mode;
 		int					m_sample;
 		int					m_alpha;
 		int					m_factor;
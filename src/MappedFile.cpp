@@ -0,0 +1,183 @@
+#include "MappedFile.h"
+
+#include <utility>
+#include <errno.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+
+//-------------------------------------------------------------------------------------------------
+// MappedFile
+//-------------------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: m_Data(0), m_Size(0), m_File(INVALID_HANDLE_VALUE), m_Mapping(0)
+{
+}
+
+bool MappedFile::open(const std::string &filename)
+{
+	close();
+
+	m_File = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_File == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0 || (unsigned long long)fileSize.QuadPart > (size_t)-1)
+	{
+		close();
+		return false;
+	}
+
+	m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_Mapping)
+	{
+		close();
+		return false;
+	}
+
+	m_Data = (const unsigned char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_Data)
+	{
+		close();
+		return false;
+	}
+
+	m_Size = size_t(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_Data) UnmapViewOfFile(m_Data);
+	if (m_Mapping) CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE) CloseHandle(m_File);
+
+	m_Data = 0;
+	m_Size = 0;
+	m_Mapping = 0;
+	m_File = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: m_Data(0), m_Size(0), m_File(-1)
+{
+}
+
+bool MappedFile::open(const std::string &filename)
+{
+	close();
+
+	m_File = ::open(filename.c_str(), O_RDONLY);
+	if (m_File < 0) return false;
+
+	struct stat info;
+	if (fstat(m_File, &info) != 0 || info.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void *data = mmap(0, size_t(info.st_size), PROT_READ, MAP_PRIVATE, m_File, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	m_Data = (const unsigned char*)data;
+	m_Size = size_t(info.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_Data) munmap((void*)m_Data, m_Size);
+	if (m_File >= 0) ::close(m_File);
+
+	m_Data = 0;
+	m_Size = 0;
+	m_File = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+const bool MappedFile::isOpen() const
+{
+	return m_Data != 0;
+}
+
+void MappedFile::swap(MappedFile &other)
+{
+	std::swap(m_Data, other.m_Data);
+	std::swap(m_Size, other.m_Size);
+	std::swap(m_File, other.m_File);
+#ifdef _WIN32
+	std::swap(m_Mapping, other.m_Mapping);
+#endif
+}
+
+const unsigned char* MappedFile::data() const
+{
+	return m_Data;
+}
+
+const size_t MappedFile::size() const
+{
+	return m_Size;
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Large Files
+//-------------------------------------------------------------------------------------------------
+
+int seekFile(FILE *file, const long long offset, const int origin)
+{
+#ifdef _MSC_VER
+	return _fseeki64(file, offset, origin);
+#else
+	return fseeko(file, off_t(offset), origin);
+#endif
+}
+
+long long tellFile(FILE *file)
+{
+#ifdef _MSC_VER
+	return _ftelli64(file);
+#else
+	return (long long)ftello(file);
+#endif
+}
+
+long long fileSize(FILE *file)
+{
+	if (seekFile(file, 0, SEEK_END) != 0) return -1;
+	return tellFile(file);
+}
+
+#ifndef _MSC_VER
+int fopen_s(FILE **file, const char *filename, const char *mode)
+{
+	*file = fopen(filename, mode);
+	return *file ? 0 : errno;
+}
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <stdio.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// MappedFile
+//-------------------------------------------------------------------------------------------------
+
+// read-only memory mapping of a whole file; pages are loaded by the OS when first touched
+
+class MappedFile
+{
+
+	public:
+
+		MappedFile();
+		~MappedFile();
+
+		bool					open(const std::string &filename);
+		void					close();
+
+		const bool				isOpen() const;
+
+		// exchanges the mappings of both files
+		void					swap(MappedFile &other);
+
+		// FILE DATA
+
+		const unsigned char*	data() const;
+		const size_t			size() const;
+
+	private:
+
+		MappedFile(const MappedFile &other);
+		MappedFile&				operator=(const MappedFile &other);
+
+		const unsigned char		*m_Data;
+		size_t					m_Size;
+
+#ifdef _WIN32
+		void					*m_File;			// HANDLE of the file
+		void					*m_Mapping;			// HANDLE of the file mapping
+#else
+		int						m_File;
+#endif
+
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// Large Files
+//-------------------------------------------------------------------------------------------------
+
+// fseek() and ftell() with 64bit offsets, which files beyond 2GB need
+int						seekFile(FILE *file, const long long offset, const int origin);
+long long				tellFile(FILE *file);
+
+// size of an open file in bytes, -1 on errors; moves the file position to the end
+long long				fileSize(FILE *file);
+
+#ifndef _MSC_VER
+// fopen_s() is only part of the Microsoft CRT
+int						fopen_s(FILE **file, const char *filename, const char *mode);
+#endif
@@ -56,8 +56,12 @@ const int MultiSet::size() const
 // MultiSet File Loader
 //-------------------------------------------------------------------------------------------------
 
-bool MultiSet::loadFromFile(QString filename, QProgressBar* progressBar)
+bool MultiSet::loadFromFile(QString filename, Progress* progress)
 {
+	// loaders may run without anyone watching their progress
+	Progress noProgress;
+	if (!progress) progress = &noProgress;
+
 	std::string filenameStr = filename.toStdString();
 	std::ifstream csvFile(filenameStr);
 	if (!csvFile.is_open())
@@ -69,7 +73,7 @@ bool MultiSet::loadFromFile(QString filename, QProgressBar* progressBar)
 	std::ifstream cntLines(filenameStr);
 	int numLines = std::count(std::istreambuf_iterator<char>(cntLines), std::istreambuf_iterator<char>(), '\n') + 1;
 	cntLines.close();
-	progressBar->setRange(0, numLines);
+	progress->setRange(0, numLines);
 
 
 	// read file line by line
@@ -79,7 +83,7 @@ bool MultiSet::loadFromFile(QString filename, QProgressBar* progressBar)
 
 	while (std::getline(csvFile, line))
 	{
-		progressBar->setValue(l);
+		progress->setValue(l);
 
 		std::stringstream lineStream(line);
 		std::string cell;
@@ -138,7 +142,7 @@ bool MultiSet::loadFromFile(QString filename, QProgressBar* progressBar)
 	m_Size = m_DataElements.size();
 	m_DataElements.resize(m_Size);
 
-	progressBar->setValue(0);
+	progress->setValue(numLines);
 
 	std::cout << "Loaded MULTIVARIATE with " << m_Dimensions << " dimensions and " << m_Size << " elements " << std::endl;
 
@@ -4,7 +4,9 @@
 #include <string>
 #include <iostream>
 
-#include <QProgressBar>
+#include <QString>
+
+#include "Progress.h"
 
 
 //-------------------------------------------------------------------------------------------------
@@ -53,7 +55,7 @@ class MultiSet
 
 		// FILE LOADER
 
-		bool								loadFromFile(QString filename, QProgressBar* progressBar);
+		bool								loadFromFile(QString filename, Progress* progress = 0);
 
 
 	private:
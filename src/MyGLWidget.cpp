@@ -7,12 +7,14 @@ MyGLWidget::MyGLWidget(QWidget *parent) :
 QGLWidget(QGLFormat(QGL::SampleBuffers), parent)
 {
 	success = false;
-	start = false;
+	worker = 0;
+	frame.width = 0;
+	frame.height = 0;
 }
 
 MyGLWidget::~MyGLWidget()
 {
-
+	delete worker;
 }
 
 QSize MyGLWidget::sizeHint() const
@@ -40,20 +42,12 @@ void MyGLWidget::paintGL()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glLoadIdentity();
 
-	if (success)
-	{
-		std::cout << "MyGLWidget start raycasting" << std::endl;
-		
-		std::vector<float> pixels = volume->rayCasting2();
-
-		int width = volume->width() * volume->getScaleFactor();
-		int height = volume->height() * volume->getScaleFactor();
-
-		glDrawPixels(width, height, GL_LUMINANCE, GL_FLOAT, &pixels[0]);
-
-		std::cout << "MyGLWidget end raycasting" << std::endl;	
+	// pick up the newest frame of the worker
+	if (success) worker->takeFrame(frame);
 
-		start = false;
+	if (!frame.pixels.empty())
+	{
+		glDrawPixels(frame.width, frame.height, GL_LUMINANCE, GL_FLOAT, &frame.pixels[0]);
 	}
 }
 
@@ -61,12 +55,19 @@ void MyGLWidget::setVolume(Volume* v)
 {
 	std::cout << "MyGLWidget set Volume" << std::endl;
 	this->volume = v;
+
+	// the worker of a previous volume cancels its frame before it is replaced
+	delete worker;
+	worker = v ? new RenderWorker(v, [this] { QMetaObject::invokeMethod(this, "updateGL", Qt::QueuedConnection); }) : 0;
+	frame.pixels.clear();
 	
-	success = true;
+	success = v != 0;
 }
 
-void MyGLWidget::startRendering()
+void MyGLWidget::requestFrame(const RenderWorker::Settings &settings)
 {
-	start = true;
-	paintGL();
+	if (success)
+	{
+		worker->request(settings);
+	}
 }
\ No newline at end of file
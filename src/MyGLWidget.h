@@ -20,6 +20,7 @@
 #include <QGLShaderProgram>
 #include <vector>
 #include "Volume.h"
+#include "RenderWorker.h"
 
 class MyGLWidget : public QGLWidget
 {
@@ -31,7 +32,9 @@ public:
 	Volume* volume;
 
 	void setVolume(Volume* v);
-	void startRendering();
+
+	// hands the settings to the render worker; the widget repaints once a frame is finished
+	void requestFrame(const RenderWorker::Settings &settings);
 
 protected:
 	void initializeGL();
@@ -41,7 +44,10 @@ protected:
 
 private:
 	bool success;
-	bool start;
+
+	// renders in the background; paintGL() only draws the frame on screen
+	RenderWorker* worker;
+	RenderWorker::Frame frame;
 
 };
 #endif
\ No newline at end of file
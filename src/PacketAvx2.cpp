@@ -0,0 +1,230 @@
+// this translation unit is compiled for AVX2 (/arch:AVX2 in the projects)
+#ifdef __GNUC__
+	#pragma GCC target("avx2")
+#endif
+
+#include "PacketAvx2.h"
+#include "Avx2Voxels.h"
+
+
+//-------------------------------------------------------------------------------------------------
+// Ray Packets with AVX2
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	using namespace avx2;
+
+	// Without scaling the eight rays run through eight consecutive voxels of a row, which a
+	// packet starting at a multiple of eight never leaves a brick for, so one load does.
+
+	inline __m256 loadRow(const float *data, const float * /*lut*/)
+	{
+		return _mm256_loadu_ps(data);
+	}
+
+	inline __m256 loadRow(const unsigned short *data, const float *lut)
+	{
+		__m256i value = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)data));
+		value = _mm256_min_epi32(value, _mm256_set1_epi32(4095));
+
+		return _mm256_i32gather_ps(lut, value, 4);
+	}
+
+	inline __m256 loadRow(const unsigned char *data, const float *lut)
+	{
+		const __m256i value = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)data));
+
+		return _mm256_i32gather_ps(lut, value, 4);
+	}
+
+	inline int countLanes(const int mask)
+	{
+		int count = 0;
+		for (int bits = mask; bits; bits &= bits - 1) count++;
+		return count;
+	}
+
+	template<PacketCompositing Compositing, typename T, class Axes>
+	void castPacket(const T *data, const float *lut, const VoxelGrid &grid, const Axes &axes, const PacketFrame &frame, RayPacket &packet)
+	{
+		const int samples = frame.sampleDistance;
+		const bool contiguous = frame.factor == 1;
+		const __m256i lastStart = _mm256_set1_epi32(int(grid.voxels) - int(4 / sizeof(T)));
+
+		// positions of the rays as in castRay(), with the corners and fractions of the
+		// interpolation; rays through voxel centres have zero fractions and give the voxel
+		float positionX[8];
+		float positionY[8];
+		for (int k = 0; k < 8; k++)
+		{
+			positionX[k] = (float)(packet.x + k) / (float)frame.factor;
+			positionY[k] = (float)packet.y / (float)frame.factor;
+		}
+
+		__m256i x0, x1, y0, y1;
+		__m256 fx, fy;
+		corners(positionX, grid.width, x0, x1, fx);
+		corners(positionY, grid.height, y0, y1, fy);
+
+		const __m256i offsetX0 = axes.x(x0);
+		const __m256i offsetX1 = axes.x(x1);
+		const __m256i offsetY0 = axes.y(y0);
+		const __m256i offsetY1 = axes.y(y1);
+		const __m256i offsetRow = _mm256_add_epi32(offsetX0, offsetY0);
+
+		// macrocell column of every ray
+		int cellColumn[8];
+		for (int k = 0; k < 8; k++)
+		{
+			cellColumn[k] = (int)positionX[k] / frame.macrocell + ((int)positionY[k] / frame.macrocell) * frame.cellsX;
+		}
+		const __m256i cells = _mm256_loadu_si256((const __m256i*)cellColumn);
+		const int cellSlice = frame.cellsX * frame.cellsY;
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 transparency = _mm256_set1_ps(frame.transparency);
+		const __m256 threshold = _mm256_set1_ps(frame.threshold);
+
+		__m256 state = zero;
+		__m256 opacity = zero;
+		__m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		int activeLanes = 0xFF;
+
+		long long taken = 0;
+		long long skipped = 0;
+
+		int z = 0;
+		while (z < grid.depth && activeLanes)
+		{
+			const int cellZ = z / frame.macrocell;
+			const int cellEnd = ((cellZ + 1) * frame.macrocell < grid.depth) ? (cellZ + 1) * frame.macrocell : grid.depth;
+
+			// jump over the cell when it cannot change any running ray
+			if (frame.skipEmptySpace)
+			{
+				const __m256 maximum = _mm256_i32gather_ps(frame.cellMax + cellZ * cellSlice, cells, 4);
+				const __m256 canSkip = (Compositing == PACKET_MIP) ?
+					_mm256_cmp_ps(maximum, state, _CMP_LE_OQ) :
+					_mm256_cmp_ps(maximum, zero, _CMP_LE_OQ);
+
+				if (_mm256_movemask_ps(_mm256_andnot_ps(canSkip, active)) == 0)
+				{
+					const int steps = (cellEnd - z + samples - 1) / samples;
+					z += steps * samples;
+					skipped += (long long)steps * countLanes(activeLanes);
+					continue;
+				}
+			}
+
+			for (; z < cellEnd && activeLanes; z += samples)
+			{
+				const __m256i offsetZ = axes.z(_mm256_set1_epi32(z));
+				__m256 value;
+
+				if (contiguous)
+				{
+					const int first = _mm_cvtsi128_si32(_mm256_castsi256_si128(_mm256_add_epi32(offsetRow, offsetZ)));
+					value = loadRow(data + first, lut);
+				}
+				else
+				{
+					// bilinear in the slice; the fraction along z is always zero
+					const __m256i edge0 = _mm256_add_epi32(offsetY0, offsetZ);
+					const __m256i edge1 = _mm256_add_epi32(offsetY1, offsetZ);
+
+					const __m256 c0 = lerp(
+						gather(data, lut, _mm256_add_epi32(offsetX0, edge0), lastStart),
+						gather(data, lut, _mm256_add_epi32(offsetX1, edge0), lastStart), fx);
+					const __m256 c1 = lerp(
+						gather(data, lut, _mm256_add_epi32(offsetX0, edge1), lastStart),
+						gather(data, lut, _mm256_add_epi32(offsetX1, edge1), lastStart), fx);
+
+					value = lerp(c0, c1, fy);
+				}
+
+				taken += countLanes(activeLanes);
+
+				if (Compositing == PACKET_MIP)
+				{
+					state = _mm256_max_ps(value, state);
+				}
+				else if (Compositing == PACKET_FIRST_HIT)
+				{
+					const __m256 hit = _mm256_and_ps(_mm256_cmp_ps(value, zero, _CMP_GT_OQ), active);
+					state = _mm256_blendv_ps(state, value, hit);
+					active = _mm256_andnot_ps(hit, active);
+				}
+				else if (Compositing == PACKET_AVERAGE)
+				{
+					state = _mm256_add_ps(state, value);
+				}
+				else
+				{
+					// over operator; the colour is the state, the opacity decides the termination
+					const __m256 alpha = _mm256_min_ps(_mm256_mul_ps(value, transparency), one);
+					const __m256 visible = _mm256_sub_ps(one, opacity);
+					const __m256 weight = _mm256_mul_ps(visible, alpha);
+
+					state = _mm256_blendv_ps(state, _mm256_add_ps(state, _mm256_mul_ps(weight, value)), active);
+					opacity = _mm256_blendv_ps(opacity, _mm256_add_ps(opacity, weight), active);
+
+					const __m256 opaque = _mm256_and_ps(_mm256_cmp_ps(opacity, threshold, _CMP_GE_OQ), active);
+					active = _mm256_andnot_ps(opaque, active);
+				}
+
+				activeLanes = _mm256_movemask_ps(active);
+			}
+		}
+
+		_mm256_storeu_ps(packet.state, state);
+
+		packet.samples = taken;
+		packet.skipped = skipped;
+	}
+
+	template<typename T, class Axes>
+	void castPacket(const T *data, const float *lut, const VoxelGrid &grid, const Axes &axes, const PacketFrame &frame, RayPacket &packet)
+	{
+		switch (frame.compositing)
+		{
+			case PACKET_MIP:		castPacket<PACKET_MIP>(data, lut, grid, axes, frame, packet); break;
+			case PACKET_FIRST_HIT:	castPacket<PACKET_FIRST_HIT>(data, lut, grid, axes, frame, packet); break;
+			case PACKET_AVERAGE:	castPacket<PACKET_AVERAGE>(data, lut, grid, axes, frame, packet); break;
+			case PACKET_ALPHA:		castPacket<PACKET_ALPHA>(data, lut, grid, axes, frame, packet); break;
+
+			// renderImage() keeps compositors without a packet kernel off the packets, so the
+			// packet is left untouched
+			case PACKET_NONE:		break;
+		}
+	}
+
+	template<typename T>
+	void dispatch(const T *data, const float *lut, const VoxelGrid &grid, const PacketFrame &frame, RayPacket &packet)
+	{
+		if (grid.bricked)
+		{
+			castPacket(data, lut, grid, BrickedAxes(grid), frame, packet);
+		}
+		else
+		{
+			castPacket(data, lut, grid, LinearAxes(grid), frame, packet);
+		}
+	}
+}
+
+void castPacketAvx2(const float *data, const float *lut, const VoxelGrid &grid, const PacketFrame &frame, RayPacket &packet)
+{
+	dispatch(data, lut, grid, frame, packet);
+}
+
+void castPacketAvx2(const unsigned short *data, const float *lut, const VoxelGrid &grid, const PacketFrame &frame, RayPacket &packet)
+{
+	dispatch(data, lut, grid, frame, packet);
+}
+
+void castPacketAvx2(const unsigned char *data, const float *lut, const VoxelGrid &grid, const PacketFrame &frame, RayPacket &packet)
+{
+	dispatch(data, lut, grid, frame, packet);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "TrilinearAvx2.h"
+
+
+//-------------------------------------------------------------------------------------------------
+// Ray Packets with AVX2
+//-------------------------------------------------------------------------------------------------
+
+// Eight neighbouring rays of an axis-aligned projection are cast together, one ray per AVX2
+// lane. The rays share the loop over z and the empty-space skipping; a macrocell is only
+// jumped over when it cannot change any ray that is still running. Rays which terminate are
+// masked out until all eight are done. Every lane takes the same samples in the same order
+// as castRay() and composites them with the same operations, so the image is identical.
+
+// the compositors of the ray caster; PACKET_NONE marks compositors without a packet kernel
+enum PacketCompositing
+{
+	PACKET_NONE				= -1,
+	PACKET_MIP				= 0,
+	PACKET_FIRST_HIT		= 1,
+	PACKET_AVERAGE			= 2,
+	PACKET_ALPHA			= 3
+};
+
+// settings shared by all packets of a frame
+struct PacketFrame
+{
+	PacketCompositing		compositing;
+	float					transparency;
+	float					threshold;		// opacity which terminates alpha compositing
+	int						sampleDistance;
+	int						factor;			// image pixels per voxel
+
+	bool					skipEmptySpace;
+	const float				*cellMax;		// maximum of every macrocell, x fastest
+	int						cellsX;
+	int						cellsY;
+	int						macrocell;		// edge length of a macrocell in voxels
+};
+
+// Image pixels (x .. x + 7, y) and the state of their rays after casting: the maximum, the
+// first hit, the sum of the samples or the composited colour. x has to be a multiple of
+// eight and x + 7 inside the image.
+struct RayPacket
+{
+	int						x;
+	int						y;
+
+	float					state[8];
+
+	long long				samples;
+	long long				skipped;
+};
+
+// the grid must not have more than MAX_GATHER_VOXELS voxels
+void castPacketAvx2(const float *data, const float *lut, const VoxelGrid &grid, const PacketFrame &frame, RayPacket &packet);
+void castPacketAvx2(const unsigned short *data, const float *lut, const VoxelGrid &grid, const PacketFrame &frame, RayPacket &packet);
+void castPacketAvx2(const unsigned char *data, const float *lut, const VoxelGrid &grid, const PacketFrame &frame, RayPacket &packet);
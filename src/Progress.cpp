@@ -0,0 +1,57 @@
+#include "Progress.h"
+
+
+//-------------------------------------------------------------------------------------------------
+// Progress
+//-------------------------------------------------------------------------------------------------
+
+Progress::Progress()
+	: m_Minimum(0), m_Maximum(100), m_Value(0)
+{
+}
+
+Progress::~Progress()
+{
+}
+
+void Progress::setRange(const long long minimum, const long long maximum)
+{
+	m_Minimum = minimum;
+	m_Maximum = maximum;
+	m_Value = minimum;
+}
+
+void Progress::setValue(const long long value)
+{
+	m_Value.store(value, std::memory_order_relaxed);
+}
+
+void Progress::add(const long long amount)
+{
+	m_Value.fetch_add(amount, std::memory_order_relaxed);
+}
+
+const long long Progress::minimum() const
+{
+	return m_Minimum;
+}
+
+const long long Progress::maximum() const
+{
+	return m_Maximum;
+}
+
+const long long Progress::value() const
+{
+	return m_Value.load(std::memory_order_relaxed);
+}
+
+const float Progress::fraction() const
+{
+	const long long minimum = m_Minimum;
+	const long long maximum = m_Maximum;
+	if (maximum <= minimum) return 0.0f;
+
+	const float f = float(double(value() - minimum) / double(maximum - minimum));
+	return f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+
+
+//-------------------------------------------------------------------------------------------------
+// Progress
+//-------------------------------------------------------------------------------------------------
+
+// Progress of a long running task such as a file loader. The task updates the counters from
+// any thread without locking; a user interface polls fraction() at its own frame rate.
+
+class Progress
+{
+
+	public:
+
+		Progress();
+		~Progress();
+
+		// TASK SIDE
+
+		void					setRange(const long long minimum, const long long maximum);
+		void					setValue(const long long value);
+		void					add(const long long amount);
+
+		// OBSERVER SIDE
+
+		const long long			minimum() const;
+		const long long			maximum() const;
+		const long long			value() const;
+
+		// progress in the interval [0.0 .. 1.0]
+		const float				fraction() const;
+
+	private:
+
+		std::atomic<long long>	m_Minimum;
+		std::atomic<long long>	m_Maximum;
+		std::atomic<long long>	m_Value;
+
+};
@@ -0,0 +1,105 @@
+#include "RenderWorker.h"
+
+#include <algorithm>
+
+
+//-------------------------------------------------------------------------------------------------
+// RenderWorker
+//-------------------------------------------------------------------------------------------------
+
+RenderWorker::RenderWorker(Volume *volume, const std::function<void()> &frameReady)
+	: m_Volume(volume), m_FrameReady(frameReady), m_Pending(), m_HasPending(false), m_Quit(false), m_Cancel(false), m_Back(), m_Front(), m_FrontReady(false)
+{
+	m_Volume->setCancelFlag(&m_Cancel);
+
+	// started last, so that the thread only sees initialised members
+	m_Thread = std::thread(&RenderWorker::workerLoop, this);
+}
+
+RenderWorker::~RenderWorker()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+		m_Cancel = true;
+	}
+	m_WakeUp.notify_all();
+
+	// a frame in progress stops at its next tile
+	m_Thread.join();
+
+	m_Volume->setCancelFlag(0);
+}
+
+void RenderWorker::request(const Settings &settings)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Pending = settings;
+		m_HasPending = true;
+		m_Cancel = true;
+	}
+	m_WakeUp.notify_all();
+}
+
+bool RenderWorker::takeFrame(Frame &frame)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!m_FrontReady) return false;
+
+	std::swap(frame, m_Front);
+	m_FrontReady = false;
+
+	return true;
+}
+
+void RenderWorker::workerLoop()
+{
+	for (;;)
+	{
+		Settings settings;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WakeUp.wait(lock, [this] { return m_HasPending || m_Quit; });
+			if (m_Quit) return;
+
+			settings = m_Pending;
+			m_HasPending = false;
+			m_Cancel = false;
+		}
+
+		switch (settings.mode)
+		{
+			case Volume::MIP:				m_Volume->setMip(); break;
+			case Volume::FIRST_HIT:			m_Volume->setFirstHit(); break;
+			case Volume::AVERAGE:			m_Volume->setAverage(); break;
+			case Volume::ALPHA_COMPOSITING:	m_Volume->setAlphaCompositing(); break;
+		}
+
+		m_Volume->setSampleDistance(settings.sampleDistance);
+		m_Volume->setScaleFactor(settings.scaleFactor);
+		m_Volume->setTransparency(settings.transparency);
+
+		// progressive refinement from the coarsest level down to the full frame; a newer
+		// request cancels the pass in progress and the ones still to come
+		for (int level = std::min(settings.firstLevel, m_Volume->levels()); level >= 0; level--)
+		{
+			m_Back.pixels = m_Volume->rayCastingPreview(level);
+			if (m_Cancel) break;
+
+			m_Back.width = m_Volume->width() * settings.scaleFactor;
+			m_Back.height = m_Volume->height() * settings.scaleFactor;
+			m_Back.stats = m_Volume->renderStats();
+			m_Back.complete = level == 0;
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				std::swap(m_Back, m_Front);
+				m_FrontReady = true;
+			}
+
+			if (m_FrameReady) m_FrameReady();
+		}
+	}
+}
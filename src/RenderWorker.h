@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Volume.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+
+//-------------------------------------------------------------------------------------------------
+// RenderWorker
+//-------------------------------------------------------------------------------------------------
+
+// Renders the frames of one volume on a thread of its own. Requests only replace the one
+// waiting, so that a burst of parameter changes renders the most recent settings once, and
+// cancel the pass in progress, which is dropped unfinished.
+// Finished frames go to a back buffer which is swapped with the front buffer, and the user
+// interface takes the front buffer whenever frameReady() tells it about a new one.
+//
+// While a worker exists it is the only one changing the render settings of its volume.
+
+class RenderWorker
+{
+
+	public:
+
+		struct Settings
+		{
+			Volume::RenderMode	mode;
+			int					sampleDistance;
+			int					scaleFactor;
+			float				transparency;
+
+			// coarsest pyramid level to start the progressive refinement from, limited to the
+			// levels of the volume; 0 renders the full frame only
+			int					firstLevel;
+		};
+
+		struct Frame
+		{
+			std::vector<float>	pixels;
+			int					width;
+			int					height;
+			Volume::RenderStats	stats;
+			bool				complete;		// last pass of its request
+		};
+
+		// frameReady is called on the worker thread after every finished frame
+		RenderWorker(Volume *volume, const std::function<void()> &frameReady);
+		~RenderWorker();
+
+		// REQUESTS
+
+		// replaces a request which has not been started yet and cancels the one in progress;
+		// its current pass stops at the next tile or band of rows
+		void					request(const Settings &settings);
+
+		// FRAMES
+
+		// swaps the newest finished frame into frame; false if none was finished since
+		bool					takeFrame(Frame &frame);
+
+	private:
+
+		void					workerLoop();
+
+		Volume								*m_Volume;
+		std::function<void()>				m_FrameReady;
+
+		std::thread							m_Thread;
+		std::mutex							m_Mutex;
+		std::condition_variable				m_WakeUp;
+
+		Settings							m_Pending;
+		bool								m_HasPending;
+		bool								m_Quit;
+
+		// set with a newer request or the end of the worker, the cancel flag of the volume
+		std::atomic<bool>					m_Cancel;
+
+		// DOUBLE BUFFER
+
+		Frame								m_Back;			// only touched by the worker thread
+		Frame								m_Front;		// newest finished frame, guarded by m_Mutex
+		bool								m_FrontReady;
+
+};
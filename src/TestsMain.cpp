@@ -0,0 +1,911 @@
+#include "Volume.h"
+#include "BenchmarkData.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <math.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// Renderer Tests
+//-------------------------------------------------------------------------------------------------
+
+// Runs the correctness checks of the renderer one after the other and exits with 1 if any of
+// them fails, e.g.
+//
+//   Tests --scratch C:\Temp
+//
+// The checks which load files write them to the scratch directory (the working directory by
+// default) and remove them again. The indexing check writes a volume of 4.3 GB there unless
+// the file system keeps it sparse; --skip-indexing leaves it out.
+
+namespace
+{
+
+	//---------------------------------------------------------------------------------------------
+	// Fixture Files
+	//---------------------------------------------------------------------------------------------
+
+	// volume files are little endian, whatever the host
+	void writeLittleEndian(std::ostream &file, unsigned int value, const int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+		{
+			file.put(char((value >> (8 * i)) & 0xff));
+		}
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Image Comparison
+	//---------------------------------------------------------------------------------------------
+
+	// Different code paths give the same image up to rounding: compilers may contract a
+	// multiplication and an addition into one fused multiply-add in one path and not in the
+	// other, e.g. with -mfma, which changes the last bits of a pixel.
+	const float IMAGE_TOLERANCE = 1e-5f;
+
+	bool sameImage(const std::vector<float> &image, const std::vector<float> &reference)
+	{
+		if (image.size() != reference.size()) return false;
+
+		for (size_t i = 0; i < image.size(); i++)
+		{
+			if (!(fabs(image[i] - reference[i]) <= IMAGE_TOLERANCE)) return false;
+		}
+		return true;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Thread Check
+	//---------------------------------------------------------------------------------------------
+
+	// Every pixel is computed by one thread alone, so frames rendered on one thread and on
+	// several have to be bit-identical, in every mode and along every traversal.
+
+	bool checkThreads()
+	{
+		const Volume::RenderMode modes[] = { Volume::MIP, Volume::FIRST_HIT, Volume::AVERAGE, Volume::ALPHA_COMPOSITING };
+		const Volume::Traversal traversals[] = { Volume::TRAVERSAL_AUTO, Volume::RAY_MAJOR, Volume::SLICE_MAJOR };
+		const int n = 64;
+
+		Volume volume;
+		if (!volume.loadFromData(n, n, n, generateVolume(PHANTOM, n)))
+		{
+			return false;
+		}
+
+		bool passed = true;
+
+		for (int m = 0; m < 4; m++)
+		{
+			setMode(volume, modes[m]);
+
+			for (int t = 0; t < 3; t++)
+			{
+				for (int scale = 1; scale <= 2; scale++)
+				{
+					volume.setTraversal(traversals[t]);
+					volume.setScaleFactor(scale);
+					volume.setSampleDistance(scale);
+
+					ThreadPool::instance().setNumThreads(1);
+					const std::vector<float> single = volume.rayCasting2();
+					ThreadPool::instance().setNumThreads(8);
+					const std::vector<float> multiple = volume.rayCasting2();
+
+					if (single != multiple)
+					{
+						std::cerr << "+ Error: " << modeName(modes[m]) << ", " << traversalName(traversals[t]) << ", scale " << scale
+							<< ": the image on 8 threads differs from the one on a single thread" << std::endl;
+						passed = false;
+					}
+				}
+			}
+		}
+
+		ThreadPool::instance().setNumThreads(0);
+
+		std::cerr << (passed ? "Thread check passed" : "+ Thread check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Cross-Path Check
+	//---------------------------------------------------------------------------------------------
+
+	// Packets, ray-major and slice-major traversal, linear and bricked layout and all storage
+	// types have to render the same images as the scalar ray caster on linear 16bit voxels, in
+	// every mode and for sample distances and scales which do and do not divide the volume. The
+	// voxels are multiples of 4095 / 15, which 8bit storage keeps exactly.
+
+	bool checkPaths()
+	{
+		const Volume::RenderMode modes[] = { Volume::MIP, Volume::FIRST_HIT, Volume::AVERAGE, Volume::ALPHA_COMPOSITING };
+		const Volume::Traversal traversals[] = { Volume::RAY_MAJOR, Volume::SLICE_MAJOR, Volume::RAY_PACKETS };
+		const Volume::Storage storages[] = { Volume::STORAGE_UINT16, Volume::STORAGE_FLOAT, Volume::STORAGE_UINT8 };
+		const Volume::Layout layouts[] = { Volume::LAYOUT_LINEAR, Volume::LAYOUT_BRICKED };
+		const int n = 48;
+
+		std::vector<unsigned short> voxels = generateVolume(PHANTOM, n);
+		for (size_t i = 0; i < voxels.size(); i++)
+		{
+			voxels[i] = (unsigned short)((voxels[i] * 15 + 2047) / 4095 * 273);
+		}
+
+		Volume volumes[3][2];
+		for (int s = 0; s < 3; s++)
+		{
+			for (int l = 0; l < 2; l++)
+			{
+				volumes[s][l].setStorage(storages[s]);
+				volumes[s][l].setLayout(layouts[l]);
+				if (!volumes[s][l].loadFromData(n, n, n, voxels)) return false;
+			}
+		}
+
+		bool passed = true;
+
+		for (int m = 0; m < 4; m++)
+		{
+			for (int samples = 1; samples <= 3; samples += 2)
+			{
+				for (int scale = 1; scale <= 2; scale++)
+				{
+					std::vector<float> reference;
+
+					for (int s = 0; s < 3; s++)
+					{
+						for (int l = 0; l < 2; l++)
+						{
+							for (int t = 0; t < 3; t++)
+							{
+								Volume &volume = volumes[s][l];
+								setMode(volume, modes[m]);
+								volume.setSampleDistance(samples);
+								volume.setScaleFactor(scale);
+								volume.setTraversal(traversals[t]);
+
+								const std::vector<float> image = volume.rayCasting2();
+								if (reference.empty())
+								{
+									reference = image;
+								}
+								else if (!sameImage(image, reference))
+								{
+									std::cerr << "+ Error: " << modeName(modes[m]) << ", sample distance " << samples << ", scale " << scale << ", "
+										<< traversalName(traversals[t]) << ", storage " << s << ", layout " << l << ": the image differs from the scalar one" << std::endl;
+									passed = false;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		std::cerr << (passed ? "Cross-path check passed" : "+ Cross-path check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Alpha Cache Check
+	//---------------------------------------------------------------------------------------------
+
+	// Renders alpha compositing frames with a sequence of transparencies and termination
+	// thresholds, once with the alpha cache and once without. The images have to be the same.
+	// The first change records the samples; frames after it which only raise the transparency or
+	// lower the threshold have to come from the cache without reading a single voxel, the others
+	// may cast the rays which need more samples.
+
+	struct AlphaStep
+	{
+		float				transparency;
+		float				threshold;
+		bool				cached;			// expected without any samples
+	};
+
+	bool checkAlphaCache()
+	{
+		const AlphaStep steps[] =
+		{
+			{ 0.8f, 0.99f, false },
+			{ 0.9f, 0.99f, false },
+			{ 1.0f, 0.99f, true },
+			{ 0.3f, 0.99f, false },
+			{ 0.5f, 0.99f, true },
+			{ 0.3f, 0.95f, true },
+			{ 0.3f, 0.99f, true },
+			{ 0.05f, 0.99f, false },
+			{ 0.1f, 0.99f, true }
+		};
+		const int count = sizeof(steps) / sizeof(steps[0]);
+		const Dataset datasets[] = { SPHERE, PHANTOM };
+		const Volume::Traversal traversals[] = { Volume::TRAVERSAL_AUTO, Volume::RAY_MAJOR, Volume::SLICE_MAJOR };
+		const int n = 64;
+
+		bool passed = true;
+
+		for (int d = 0; d < 2; d++)
+		{
+			const std::vector<unsigned short> voxels = generateVolume(datasets[d], n);
+
+			for (int t = 0; t < 3; t++)
+			{
+				for (int scale = 1; scale <= 2; scale++)
+				{
+					Volume cached, reference;
+					cached.setAlphaCache(true);
+
+					if (!cached.loadFromData(n, n, n, voxels) || !reference.loadFromData(n, n, n, voxels))
+					{
+						return false;
+					}
+
+					Volume *volumes[] = { &cached, &reference };
+					for (int v = 0; v < 2; v++)
+					{
+						volumes[v]->setAlphaCompositing();
+						volumes[v]->setSampleDistance(1);
+						volumes[v]->setScaleFactor(scale);
+						volumes[v]->setTraversal(traversals[t]);
+					}
+
+					for (int i = 0; i < count; i++)
+					{
+						for (int v = 0; v < 2; v++)
+						{
+							volumes[v]->setTransparency(steps[i].transparency);
+							volumes[v]->setTerminationThreshold(steps[i].threshold);
+						}
+
+						const std::vector<float> image = cached.rayCasting2();
+						const Volume::RenderStats stats = cached.renderStats();
+
+						if (!sameImage(image, reference.rayCasting2()))
+						{
+							std::cerr << "+ Error: " << datasetName(datasets[d]) << ", " << traversalName(traversals[t]) << ", scale " << scale
+								<< ", step " << i << ": the cached image differs from the rendered one" << std::endl;
+							passed = false;
+						}
+
+						if (steps[i].cached && (stats.samples != 0 || stats.skippedSamples != 0 || stats.reusedPixels != (long long)image.size()))
+						{
+							std::cerr << "+ Error: " << datasetName(datasets[d]) << ", " << traversalName(traversals[t]) << ", scale " << scale
+								<< ", step " << i << ": " << stats.samples << " samples read, " << stats.reusedPixels << " of " << image.size() << " pixels reused" << std::endl;
+							passed = false;
+						}
+					}
+				}
+			}
+		}
+
+		std::cerr << (passed ? "Alpha cache check passed" : "+ Alpha cache check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Shallow Volume Check
+	//---------------------------------------------------------------------------------------------
+
+	// Volumes of one to four slices are loaded from memory, read and mapped from a file written
+	// to filename, read and streamed from a brick file next to it, and rendered in every mode
+	// with the sample distance the loader chose, with and without column tables. Every loader
+	// has to give the image of the volume loaded from memory, and no pixel may leave [0, 1].
+
+	bool renderShallow(Volume &volume, const char *loader, int depth, const std::vector<std::vector<float> > &reference, std::vector<std::vector<float> > &images)
+	{
+		const Volume::RenderMode modes[] = { Volume::MIP, Volume::FIRST_HIT, Volume::AVERAGE, Volume::ALPHA_COMPOSITING };
+		bool passed = true;
+
+		images.clear();
+
+		for (int tables = 0; tables < 2; tables++)
+		{
+			volume.setColumnTables(tables == 1);
+
+			for (int m = 0; m < 4; m++)
+			{
+				setMode(volume, modes[m]);
+				images.push_back(volume.rayCasting2());
+
+				const std::vector<float> &image = images.back();
+				const char *error = 0;
+
+				if (image.size() != size_t(volume.width()) * volume.height()) error = "has the wrong size";
+				else if (!reference.empty() && !sameImage(image, reference[images.size() - 1])) error = "differs from the volume loaded from memory";
+
+				for (size_t i = 0; !error && i < image.size(); i++)
+				{
+					if (!(image[i] >= 0.0f && image[i] <= 1.0f)) error = "has pixels out of range";
+				}
+
+				if (error)
+				{
+					std::cerr << "+ Error: " << loader << ", depth " << depth << ", " << modeName(modes[m])
+						<< (tables ? " from column tables" : "") << ": the image " << error << std::endl;
+					passed = false;
+				}
+			}
+		}
+
+		return passed;
+	}
+
+	bool checkShallow(const std::string &filename)
+	{
+		const int width = 24, height = 20;
+		const std::string brickFilename = filename + ".bvol";
+
+		bool passed = true;
+
+		for (int depth = 1; depth <= 4; depth++)
+		{
+			std::vector<unsigned short> voxels(size_t(width) * height * depth);
+			for (size_t i = 0; i < voxels.size(); i++)
+			{
+				voxels[i] = (unsigned short)(voxelHash(unsigned(i), 5, 11) % 4096);
+			}
+
+			{
+				std::ofstream file(filename.c_str(), std::ios::binary);
+				writeLittleEndian(file, width, 2);
+				writeLittleEndian(file, height, 2);
+				writeLittleEndian(file, depth, 2);
+				for (size_t i = 0; i < voxels.size(); i++)
+				{
+					writeLittleEndian(file, voxels[i], 2);
+				}
+
+				if (!file)
+				{
+					std::cerr << "+ Error writing file: " << filename << std::endl;
+					return false;
+				}
+			}
+
+			std::vector<std::vector<float> > reference, images;
+
+			{
+				Volume volume;
+				if (!volume.loadFromData(width, height, depth, voxels) || !volume.saveBrickFile(QString::fromStdString(brickFilename)))
+				{
+					return false;
+				}
+				passed = renderShallow(volume, "memory", depth, images, reference) && passed;
+			}
+
+			{
+				Volume volume;
+				passed = volume.loadFromFile(QString::fromStdString(filename)) && renderShallow(volume, "file", depth, reference, images) && passed;
+			}
+
+			{
+				Volume volume;
+				volume.setMemoryMapped(true);
+				passed = volume.loadFromFile(QString::fromStdString(filename)) && renderShallow(volume, "mapped file", depth, reference, images) && passed;
+			}
+
+			{
+				Volume volume;
+				passed = volume.loadFromFile(QString::fromStdString(brickFilename)) && renderShallow(volume, "brick file", depth, reference, images) && passed;
+			}
+
+			{
+				Volume volume;
+				volume.setStreamed(true);
+				passed = volume.loadFromFile(QString::fromStdString(brickFilename)) && renderShallow(volume, "streamed", depth, reference, images) && passed;
+			}
+		}
+
+		remove(filename.c_str());
+		remove(brickFilename.c_str());
+
+		std::cerr << (passed ? "Shallow volume check passed" : "+ Shallow volume check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Average Check
+	//---------------------------------------------------------------------------------------------
+
+	// The average of a constant volume is that constant for every sample distance, also where
+	// the distance does not divide the depth, along every traversal, from the column tables and
+	// from the pyramid levels.
+
+	bool checkAverage()
+	{
+		const Volume::Traversal traversals[] = { Volume::RAY_MAJOR, Volume::SLICE_MAJOR, Volume::RAY_PACKETS };
+		const int n = 12;
+		const unsigned short value = 2048;
+		const float expected = value / 4095.0f;
+
+		bool passed = true;
+
+		for (int config = 0; config < 5; config++)
+		{
+			Volume volume;
+			volume.setColumnTables(config == 3);
+			volume.setLevelOfDetail(config == 4);
+
+			if (!volume.loadFromData(n, n, n, std::vector<unsigned short>(size_t(n) * n * n, value)))
+			{
+				return false;
+			}
+
+			volume.setAverage();
+			volume.setTraversal(traversals[config % 3]);
+
+			for (int samples = 1; samples <= n + 1; samples++)
+			{
+				volume.setSampleDistance(samples);
+				const std::vector<float> image = volume.rayCasting2();
+
+				for (size_t i = 0; i < image.size(); i++)
+				{
+					if (fabs(image[i] - expected) > 1e-5f)
+					{
+						std::cerr << "+ Error: configuration " << config << ", sample distance " << samples << ": average " << image[i] << " instead of " << expected << std::endl;
+						passed = false;
+						break;
+					}
+				}
+			}
+		}
+
+		std::cerr << (passed ? "Average check passed" : "+ Average check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Cancel Check
+	//---------------------------------------------------------------------------------------------
+
+	// Frames and previews rendered while the cancel flag is set have to come back empty, and
+	// the next frame after it is cleared has to match a volume which was never cancelled, also
+	// when the cancelled frame was the one recording the alpha cache.
+
+	bool checkCancel()
+	{
+		const Volume::Traversal traversals[] = { Volume::TRAVERSAL_AUTO, Volume::RAY_MAJOR, Volume::SLICE_MAJOR };
+		const int n = 64;
+		const std::vector<unsigned short> voxels = generateVolume(PHANTOM, n);
+
+		bool passed = true;
+
+		for (int t = 0; t < 3; t++)
+		{
+			Volume cancelled, reference;
+			cancelled.setAlphaCache(true);
+			cancelled.setLevelOfDetail(true);
+
+			if (!cancelled.loadFromData(n, n, n, voxels) || !reference.loadFromData(n, n, n, voxels))
+			{
+				return false;
+			}
+
+			std::atomic<bool> cancel(false);
+			cancelled.setCancelFlag(&cancel);
+
+			Volume *volumes[] = { &cancelled, &reference };
+			for (int v = 0; v < 2; v++)
+			{
+				volumes[v]->setAlphaCompositing();
+				volumes[v]->setSampleDistance(1);
+				volumes[v]->setScaleFactor(2);
+				volumes[v]->setTraversal(traversals[t]);
+			}
+
+			// the first frame is cast, and the transparency change after it records the samples
+			cancelled.rayCasting2();
+			cancelled.setTransparency(0.5f);
+			reference.setTransparency(0.5f);
+
+			cancel = true;
+			const bool empty = cancelled.rayCasting2().empty() && cancelled.rayCastingPreview(1).empty();
+			cancel = false;
+
+			if (!empty || !sameImage(cancelled.rayCasting2(), reference.rayCasting2()))
+			{
+				std::cerr << "+ Error: traversal " << t << ": " << (empty ? "the frame after a cancelled one differs" : "a cancelled frame was not empty") << std::endl;
+				passed = false;
+			}
+		}
+
+		std::cerr << (passed ? "Cancel check passed" : "+ Cancel check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Storage Check
+	//---------------------------------------------------------------------------------------------
+
+	// Storage and layout only apply to the next load. A volume whose storage or layout changes
+	// after loading has to sample and render as before, and the next load has to give the same
+	// voxels and image as a volume which had the settings from the start. A streamed volume keeps
+	// the 16bit file values without touching the storage asked for, which the next load in
+	// memory then uses.
+
+	bool sameVoxels(const Volume &volume, const Volume &reference)
+	{
+		for (int z = 0; z < reference.depth(); z++)
+		{
+			for (int y = 0; y < reference.height(); y++)
+			{
+				for (int x = 0; x < reference.width(); x++)
+				{
+					if (volume.voxel(x, y, z).getValue() != reference.voxel(x, y, z).getValue()) return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool checkStorage(const std::string &filename)
+	{
+		const Volume::Storage storages[] = { Volume::STORAGE_FLOAT, Volume::STORAGE_UINT16, Volume::STORAGE_UINT8 };
+		const Volume::Layout layouts[] = { Volume::LAYOUT_LINEAR, Volume::LAYOUT_BRICKED };
+		const int n = 24;
+
+		std::vector<unsigned short> voxels(size_t(n) * n * n);
+		for (size_t i = 0; i < voxels.size(); i++)
+		{
+			voxels[i] = (unsigned short)(voxelHash(unsigned(i), 7, 13) % 4096);
+		}
+
+		bool passed = true;
+
+		for (int s = 0; s < 3; s++)
+		{
+			for (int l = 0; l < 2; l++)
+			{
+				Volume volume, loaded, fresh;
+				fresh.setStorage(storages[s]);
+				fresh.setLayout(layouts[l]);
+
+				if (!volume.loadFromData(n, n, n, voxels) || !loaded.loadFromData(n, n, n, voxels) || !fresh.loadFromData(n, n, n, voxels))
+				{
+					return false;
+				}
+
+				volume.setStorage(storages[s]);
+				volume.setLayout(layouts[l]);
+
+				if (!sameVoxels(volume, loaded) || !sameImage(volume.rayCasting2(), loaded.rayCasting2()))
+				{
+					std::cerr << "+ Error: storage " << s << ", layout " << l << ": changing the settings changed the loaded volume" << std::endl;
+					passed = false;
+				}
+
+				if (!volume.loadFromData(n, n, n, voxels) || !sameVoxels(volume, fresh) || !sameImage(volume.rayCasting2(), fresh.rayCasting2()))
+				{
+					std::cerr << "+ Error: storage " << s << ", layout " << l << ": the next load did not use the settings" << std::endl;
+					passed = false;
+				}
+			}
+		}
+
+		{
+			std::ofstream file(filename.c_str(), std::ios::binary);
+			writeLittleEndian(file, n, 2);
+			writeLittleEndian(file, n, 2);
+			writeLittleEndian(file, n, 2);
+			for (size_t i = 0; i < voxels.size(); i++)
+			{
+				writeLittleEndian(file, voxels[i], 2);
+			}
+
+			if (!file)
+			{
+				std::cerr << "+ Error writing file: " << filename << std::endl;
+				return false;
+			}
+		}
+
+		{
+			Volume volume, fresh;
+			volume.setStorage(Volume::STORAGE_UINT8);
+			fresh.setStorage(Volume::STORAGE_UINT8);
+
+			volume.setStreamed(true);
+			const bool streamed = volume.loadFromFile(QString::fromStdString(filename));
+			volume.setStreamed(false);
+
+			if (!streamed || !volume.loadFromFile(QString::fromStdString(filename)) || !fresh.loadFromData(n, n, n, voxels) || !sameVoxels(volume, fresh))
+			{
+				std::cerr << "+ Error: the load after a streamed one did not use the storage asked for" << std::endl;
+				passed = false;
+			}
+		}
+
+		remove(filename.c_str());
+
+		std::cerr << (passed ? "Storage check passed" : "+ Storage check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Failed Load Check
+	//---------------------------------------------------------------------------------------------
+
+	// A valid volume is loaded read, mapped and streamed, and then a file whose header claims
+	// more voxels than it holds, and voxels which do not match their dimensions. Both loads
+	// have to fail and leave the first volume in place, with its dimensions and its image.
+
+	bool checkFailedLoad(const std::string &filename)
+	{
+		const int width = 4, height = 4, depth = 4;
+		const std::string badFilename = filename + ".bad";
+
+		{
+			std::ofstream file(filename.c_str(), std::ios::binary);
+			writeLittleEndian(file, width, 2);
+			writeLittleEndian(file, height, 2);
+			writeLittleEndian(file, depth, 2);
+			for (int i = 0; i < width * height * depth; i++)
+			{
+				writeLittleEndian(file, 4095, 2);
+			}
+
+			std::ofstream badFile(badFilename.c_str(), std::ios::binary);
+			writeLittleEndian(badFile, 9, 2);
+			writeLittleEndian(badFile, 9, 2);
+			writeLittleEndian(badFile, 9, 2);
+
+			if (!file || !badFile)
+			{
+				std::cerr << "+ Error writing file: " << filename << std::endl;
+				return false;
+			}
+		}
+
+		const char *loaders[] = { "file", "mapped file", "streamed" };
+		bool passed = true;
+
+		for (int loader = 0; loader < 3; loader++)
+		{
+			Volume volume;
+			volume.setMemoryMapped(loader == 1);
+			volume.setStreamed(loader == 2);
+			volume.setLevelOfDetail(true);
+
+			if (!volume.loadFromFile(QString::fromStdString(filename)))
+			{
+				passed = false;
+				continue;
+			}
+
+			const bool loaded = volume.loadFromFile(QString::fromStdString(badFilename)) ||
+				volume.loadFromData(width, height, depth, std::vector<unsigned short>(7, 0));
+
+			const std::vector<float> image = volume.rayCasting2();
+			const bool kept = volume.width() == width && volume.height() == height && volume.depth() == depth &&
+				image.size() == size_t(width) * height && image.front() == 1.0f;
+
+			if (loaded || !kept)
+			{
+				std::cerr << "+ Error: " << loaders[loader] << ": a failed load changed the volume" << std::endl;
+				passed = false;
+			}
+		}
+
+		remove(filename.c_str());
+		remove(badFilename.c_str());
+
+		std::cerr << (passed ? "Failed load check passed" : "+ Failed load check failed") << std::endl;
+		return passed;
+	}
+
+
+	//---------------------------------------------------------------------------------------------
+	// Indexing Check
+	//---------------------------------------------------------------------------------------------
+
+	// A volume with more than 2^31 voxels, wider than the 16bit header allows, is written to
+	// filename with the extended header. It is empty apart from a few marker voxels, most of
+	// them beyond the reach of 32bit indices, so the file stays sparse where the file system
+	// supports it. The volume is loaded memory mapped and streamed, and both have to give the
+	// markers back, as voxels and as the only bright pixels of a MIP image.
+
+	struct Marker
+	{
+		int					x;
+		int					y;
+		int					z;
+		unsigned short		value;
+	};
+
+	bool checkVolume(Volume &volume, const Marker *markers, int count)
+	{
+		bool passed = true;
+
+		for (int i = 0; i < count; i++)
+		{
+			const float expected = markers[i].value / 4095.0f;
+			const float found = volume.voxel(markers[i].x, markers[i].y, markers[i].z).getValue();
+			if (found != expected)
+			{
+				std::cerr << "+ Error: voxel (" << markers[i].x << ", " << markers[i].y << ", " << markers[i].z << ") is " << found << " instead of " << expected << std::endl;
+				passed = false;
+			}
+		}
+
+		volume.setMip();
+		volume.setSampleDistance(1);
+		volume.setScaleFactor(1);
+		const std::vector<float> image = volume.rayCasting2();
+
+		long long bright = 0;
+		for (size_t i = 0; i < image.size(); i++)
+		{
+			if (image[i] > 0.0f) bright++;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			const float expected = markers[i].value / 4095.0f;
+			const float found = image[size_t(markers[i].y) * volume.width() + markers[i].x];
+			if (found != expected)
+			{
+				std::cerr << "+ Error: pixel (" << markers[i].x << ", " << markers[i].y << ") is " << found << " instead of " << expected << std::endl;
+				passed = false;
+			}
+		}
+
+		if (bright != count)
+		{
+			std::cerr << "+ Error: " << bright << " bright pixels instead of " << count << std::endl;
+			passed = false;
+		}
+
+		return passed;
+	}
+
+	bool checkIndexing(const std::string &filename)
+	{
+		const int width = 66000, height = 256, depth = 128;
+		const Marker markers[] =
+		{
+			{ 7, 3, 1, 2000 },
+			{ 12345, 200, 127, 3000 },
+			{ width - 1, height - 1, depth - 1, 4095 }
+		};
+		const int count = sizeof(markers) / sizeof(markers[0]);
+
+		std::cerr << "Writing " << width << " x " << height << " x " << depth << " volume ("
+			<< (long long)width * height * depth << " voxels) to " << filename << std::endl;
+
+		{
+			std::ofstream file(filename.c_str(), std::ios::binary);
+
+			// three 16bit zeros mark the extended header with 32bit dimensions
+			writeLittleEndian(file, 0, 2);
+			writeLittleEndian(file, 0, 2);
+			writeLittleEndian(file, 0, 2);
+			writeLittleEndian(file, width, 4);
+			writeLittleEndian(file, height, 4);
+			writeLittleEndian(file, depth, 4);
+			const long long dataOffset = 3 * 2 + 3 * 4;
+
+			// the last marker is the last voxel and gives the file its full size
+			for (int i = 0; i < count; i++)
+			{
+				const long long index = markers[i].x + (long long)markers[i].y * width + (long long)markers[i].z * width * height;
+				file.seekp(std::streamoff(dataOffset + index * (long long)sizeof(unsigned short)));
+				writeLittleEndian(file, markers[i].value, 2);
+			}
+
+			if (!file)
+			{
+				std::cerr << "+ Error writing file: " << filename << std::endl;
+				return false;
+			}
+		}
+
+		bool passed = true;
+
+		{
+			Volume volume;
+			volume.setMemoryMapped(true);
+			std::cerr << "Checking the memory mapped volume" << std::endl;
+			passed = volume.loadFromFile(QString::fromStdString(filename)) && volume.size() > (1LL << 31) && checkVolume(volume, markers, count) && passed;
+		}
+
+		{
+			Volume volume;
+			volume.setStreamed(true);
+			volume.setCacheBudget(256LL << 20);
+			std::cerr << "Checking the streamed volume" << std::endl;
+			passed = volume.loadFromFile(QString::fromStdString(filename)) && volume.size() > (1LL << 31) && checkVolume(volume, markers, count) && passed;
+		}
+
+		remove(filename.c_str());
+
+		std::cerr << (passed ? "Indexing check passed" : "+ Indexing check failed") << std::endl;
+		return passed;
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// Options
+	//---------------------------------------------------------------------------------------------
+
+	void printUsage()
+	{
+		std::cout << "usage: Tests [options]" << std::endl
+			<< std::endl
+			<< "  --scratch DIR                       directory for the files the checks write (.)" << std::endl
+			<< "  --skip-indexing                     leave out the check of a volume of more than 2^31 voxels" << std::endl
+			<< "                                      (4.3 GB unless the file system keeps it sparse)" << std::endl;
+	}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+
+	std::string scratch = ".";
+	bool indexing = true;
+
+	// parse options
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string option = argv[i];
+		const std::string argument = (i + 1 < argc) ? argv[i + 1] : "";
+
+		if (option == "--skip-indexing")
+		{
+			indexing = false;
+		}
+		else if (option == "--scratch" && !argument.empty())
+		{
+			scratch = argument;
+			i++;
+		}
+		else
+		{
+			std::cerr << "+ Unknown option: " << option << std::endl;
+			printUsage();
+			return 1;
+		}
+	}
+
+	// run every check, also after a failed one
+
+	const std::string prefix = scratch + "/tests_";
+	int failed = 0;
+
+	if (!checkThreads()) failed++;
+	if (!checkPaths()) failed++;
+	if (!checkAlphaCache()) failed++;
+	if (!checkCancel()) failed++;
+	if (!checkAverage()) failed++;
+	if (!checkShallow(prefix + "shallow.dat")) failed++;
+	if (!checkStorage(prefix + "storage.dat")) failed++;
+	if (!checkFailedLoad(prefix + "failed.dat")) failed++;
+	if (indexing && !checkIndexing(prefix + "indexing.dat")) failed++;
+
+	if (failed > 0)
+	{
+		std::cerr << "+ " << failed << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cerr << "All checks passed" << std::endl;
+	return 0;
+
+}
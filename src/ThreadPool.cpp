@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+
+
+//-------------------------------------------------------------------------------------------------
+// ThreadPool
+//-------------------------------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(int numThreads)
+	: m_Task(0), m_Count(0), m_Next(0), m_Busy(0), m_Generation(0), m_Quit(false)
+{
+	startWorkers(numThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+	stopWorkers();
+}
+
+void ThreadPool::startWorkers(int numThreads)
+{
+	if (numThreads <= 0)
+	{
+		numThreads = int(std::thread::hardware_concurrency());
+		if (numThreads <= 0) numThreads = 1;
+	}
+
+	// the thread calling parallelFor() works as well, so one worker less is needed; new
+	// workers wait for the next generation of tasks
+	for (int i = 0; i < numThreads - 1; i++)
+	{
+		m_Workers.push_back(std::thread(&ThreadPool::workerLoop, this, m_Generation));
+	}
+}
+
+void ThreadPool::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_WakeUp.notify_all();
+
+	for (size_t i = 0; i < m_Workers.size(); i++)
+	{
+		m_Workers[i].join();
+	}
+
+	m_Workers.clear();
+	m_Quit = false;
+}
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+const int ThreadPool::numThreads() const
+{
+	return int(m_Workers.size()) + 1;
+}
+
+void ThreadPool::setNumThreads(int numThreads)
+{
+	std::lock_guard<std::mutex> callLock(m_CallMutex);
+
+	stopWorkers();
+	startWorkers(numThreads);
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &task)
+{
+	if (count <= 0) return;
+
+	if (m_Workers.empty() || count == 1)
+	{
+		for (int i = 0; i < count; i++) task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> callLock(m_CallMutex);
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Task = &task;
+		m_Count = count;
+		m_Next = 0;
+		m_Busy = int(m_Workers.size());
+		m_Generation++;
+	}
+	m_WakeUp.notify_all();
+
+	runTasks();
+
+	// wait until every worker has left the task, so that 'task' may go out of scope
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Finished.wait(lock, [this] { return m_Busy == 0; });
+	m_Task = 0;
+}
+
+void ThreadPool::workerLoop(unsigned int generation)
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WakeUp.wait(lock, [&] { return m_Quit || m_Generation != generation; });
+			if (m_Quit) return;
+			generation = m_Generation;
+		}
+
+		runTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Busy--;
+		}
+		m_Finished.notify_one();
+	}
+}
+
+void ThreadPool::runTasks()
+{
+	// tasks are handed out one by one, so uneven task costs balance out across threads
+	for (int i = m_Next++; i < m_Count; i = m_Next++)
+	{
+		(*m_Task)(i);
+	}
+}
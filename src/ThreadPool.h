@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+
+//-------------------------------------------------------------------------------------------------
+// ThreadPool
+//-------------------------------------------------------------------------------------------------
+
+class ThreadPool
+{
+
+	public:
+
+		ThreadPool(int numThreads = 0);
+		~ThreadPool();
+
+		// shared pool with one thread per hardware core
+		static ThreadPool&		instance();
+
+		const int				numThreads() const;
+
+		// threads taking part in parallelFor(), the calling one included; 0 uses one per
+		// hardware core. Not to be called while other threads may call parallelFor().
+		void					setNumThreads(int numThreads);
+
+		// PARALLEL EXECUTION
+
+		// calls task(i) for every i in [0, count) and blocks until all calls have returned;
+		// the calling thread takes part in the work
+		void					parallelFor(int count, const std::function<void(int)> &task);
+
+	private:
+
+		void					startWorkers(int numThreads);
+		void					stopWorkers();
+
+		void					workerLoop(unsigned int generation);
+		void					runTasks();
+
+		std::vector<std::thread>			m_Workers;
+		std::mutex							m_Mutex;
+		std::condition_variable				m_WakeUp;
+		std::condition_variable				m_Finished;
+
+		const std::function<void(int)>		*m_Task;
+		int									m_Count;
+		std::atomic<int>					m_Next;
+		int									m_Busy;
+		unsigned int						m_Generation;
+		bool								m_Quit;
+
+		// serialises concurrent parallelFor() calls from different threads
+		std::mutex							m_CallMutex;
+
+};
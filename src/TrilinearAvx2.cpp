@@ -0,0 +1,98 @@
+// this translation unit is compiled for AVX2 (/arch:AVX2 in the projects)
+#ifdef __GNUC__
+	#pragma GCC target("avx2")
+#endif
+
+#include "TrilinearAvx2.h"
+#include "Avx2Voxels.h"
+
+
+//-------------------------------------------------------------------------------------------------
+// Trilinear Sampling with AVX2
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	using namespace avx2;
+
+	template<typename T, class Axes>
+	int trilinear(const T *data, const float *lut, const VoxelGrid &grid, const Axes &axes, const float *x, const float *y, const float *z, float *values, int count)
+	{
+		if (grid.voxels > MAX_GATHER_VOXELS) return 0;
+
+		const int last = int(grid.voxels) - int(4 / sizeof(T));
+		if (last < 0) return 0;
+
+		const __m256i lastStart = _mm256_set1_epi32(last);
+		const int groups = count & ~7;
+
+		for (int i = 0; i < groups; i += 8)
+		{
+			__m256i x0, x1, y0, y1, z0, z1;
+			__m256 fx, fy, fz;
+
+			corners(x + i, grid.width, x0, x1, fx);
+			corners(y + i, grid.height, y0, y1, fy);
+			corners(z + i, grid.depth, z0, z1, fz);
+
+			const __m256i offsetX0 = axes.x(x0);
+			const __m256i offsetX1 = axes.x(x1);
+			const __m256i offsetY0 = axes.y(y0);
+			const __m256i offsetY1 = axes.y(y1);
+			const __m256i offsetZ0 = axes.z(z0);
+			const __m256i offsetZ1 = axes.z(z1);
+
+			// the four x-edges of the cell, named by their y and z corner
+			const __m256i edge00 = _mm256_add_epi32(offsetY0, offsetZ0);
+			const __m256i edge10 = _mm256_add_epi32(offsetY1, offsetZ0);
+			const __m256i edge01 = _mm256_add_epi32(offsetY0, offsetZ1);
+			const __m256i edge11 = _mm256_add_epi32(offsetY1, offsetZ1);
+
+			const __m256 c00 = lerp(
+				gather(data, lut, _mm256_add_epi32(offsetX0, edge00), lastStart),
+				gather(data, lut, _mm256_add_epi32(offsetX1, edge00), lastStart), fx);
+			const __m256 c10 = lerp(
+				gather(data, lut, _mm256_add_epi32(offsetX0, edge10), lastStart),
+				gather(data, lut, _mm256_add_epi32(offsetX1, edge10), lastStart), fx);
+			const __m256 c01 = lerp(
+				gather(data, lut, _mm256_add_epi32(offsetX0, edge01), lastStart),
+				gather(data, lut, _mm256_add_epi32(offsetX1, edge01), lastStart), fx);
+			const __m256 c11 = lerp(
+				gather(data, lut, _mm256_add_epi32(offsetX0, edge11), lastStart),
+				gather(data, lut, _mm256_add_epi32(offsetX1, edge11), lastStart), fx);
+
+			const __m256 c0 = lerp(c00, c10, fy);
+			const __m256 c1 = lerp(c01, c11, fy);
+
+			_mm256_storeu_ps(values + i, lerp(c0, c1, fz));
+		}
+
+		return groups;
+	}
+
+	template<typename T>
+	int dispatch(const T *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count)
+	{
+		if (grid.bricked)
+		{
+			return trilinear(data, lut, grid, BrickedAxes(grid), x, y, z, values, count);
+		}
+
+		return trilinear(data, lut, grid, LinearAxes(grid), x, y, z, values, count);
+	}
+}
+
+int trilinearAvx2(const float *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count)
+{
+	return dispatch(data, lut, grid, x, y, z, values, count);
+}
+
+int trilinearAvx2(const unsigned short *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count)
+{
+	return dispatch(data, lut, grid, x, y, z, values, count);
+}
+
+int trilinearAvx2(const unsigned char *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count)
+{
+	return dispatch(data, lut, grid, x, y, z, values, count);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+
+//-------------------------------------------------------------------------------------------------
+// Trilinear Sampling with AVX2
+//-------------------------------------------------------------------------------------------------
+
+// Eight trilinear samples per step: the eight corner voxels of all positions are fetched with
+// gather instructions and blended in the same order as interpolateTrilinear(), so that both
+// paths give identical values. Only call these when useAvx2() is true; they live in their own
+// translation unit which is compiled for AVX2.
+
+// dimensions and layout of the voxel array the samples are taken from
+struct VoxelGrid
+{
+	int						width;
+	int						height;
+	int						depth;
+	long long				voxels;		// stored voxels including any brick padding
+	bool					bricked;
+};
+
+// gathers take 32bit indices, so larger grids are left to the scalar code
+const long long MAX_GATHER_VOXELS = 0x7FFFFFFF;
+
+// samples the positions (x[i], y[i], z[i]) for i in [0, count) in groups of eight and returns
+// how many were sampled; the remaining count % 8 positions are left to the caller, all of them
+// for grids above MAX_GATHER_VOXELS
+int trilinearAvx2(const float *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count);
+int trilinearAvx2(const unsigned short *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count);
+int trilinearAvx2(const unsigned char *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count);
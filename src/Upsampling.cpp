@@ -0,0 +1,125 @@
+#include "Upsampling.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <algorithm>
+
+
+//-------------------------------------------------------------------------------------------------
+// Image Upsampling
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	// weights of a separable filter for each of the factor sub-pixel phases
+	struct Filter
+	{
+		int						taps;		// input pixels per output pixel and axis
+		int						first;		// offset of the first tap from the pixel left of the position
+		std::vector<float>		weights;	// taps weights per phase
+	};
+
+	Filter bilinearFilter(int factor)
+	{
+		Filter filter;
+		filter.taps = 2;
+		filter.first = 0;
+
+		for (int phase = 0; phase < factor; phase++)
+		{
+			const float t = float(phase) / float(factor);
+			filter.weights.push_back(1.0f - t);
+			filter.weights.push_back(t);
+		}
+
+		return filter;
+	}
+
+	Filter bicubicFilter(int factor)
+	{
+		Filter filter;
+		filter.taps = 4;
+		filter.first = -1;
+
+		for (int phase = 0; phase < factor; phase++)
+		{
+			const float t = float(phase) / float(factor);
+			const float t2 = t * t;
+			const float t3 = t2 * t;
+
+			filter.weights.push_back(0.5f * (-t3 + 2.0f * t2 - t));
+			filter.weights.push_back(0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f));
+			filter.weights.push_back(0.5f * (-3.0f * t3 + 4.0f * t2 + t));
+			filter.weights.push_back(0.5f * (t3 - t2));
+		}
+
+		return filter;
+	}
+
+	void upsample(const float *in, int width, int height, int factor, const Filter &filter, bool clamp, float *out)
+	{
+		const int outWidth = width * factor;
+		const int taps = filter.taps;
+
+		// input column of every tap of every output column, clamped to the border
+		std::vector<int> columns(size_t(outWidth) * taps);
+		for (int x = 0; x < outWidth; x++)
+		{
+			for (int t = 0; t < taps; t++)
+			{
+				columns[size_t(x) * taps + t] = std::max(0, std::min(width - 1, x / factor + filter.first + t));
+			}
+		}
+
+		// every task produces factor output rows which share the same input rows
+		ThreadPool::instance().parallelFor(height, [&](int row)
+		{
+			std::vector<float> blended(width);
+
+			for (int phase = 0; phase < factor; phase++)
+			{
+				const float *rowWeights = &filter.weights[phase * taps];
+
+				// vertical pass over whole input rows, a plain multiply-add of contiguous data
+				std::fill(blended.begin(), blended.end(), 0.0f);
+				for (int t = 0; t < taps; t++)
+				{
+					const float *source = in + size_t(std::max(0, std::min(height - 1, row + filter.first + t))) * width;
+					const float w = rowWeights[t];
+
+					for (int x = 0; x < width; x++)
+					{
+						blended[x] += w * source[x];
+					}
+				}
+
+				// horizontal pass
+				float *destination = out + size_t(row * factor + phase) * outWidth;
+
+				for (int x = 0; x < outWidth; x++)
+				{
+					const int *tapColumns = &columns[size_t(x) * taps];
+					const float *columnWeights = &filter.weights[(x % factor) * taps];
+
+					float value = 0.0f;
+					for (int t = 0; t < taps; t++)
+					{
+						value += columnWeights[t] * blended[tapColumns[t]];
+					}
+
+					destination[x] = clamp ? std::max(0.0f, std::min(1.0f, value)) : value;
+				}
+			}
+		});
+	}
+}
+
+void upsampleBilinear(const float *in, int width, int height, int factor, float *out)
+{
+	upsample(in, width, height, factor, bilinearFilter(factor), false, out);
+}
+
+void upsampleBicubic(const float *in, int width, int height, int factor, float *out)
+{
+	upsample(in, width, height, factor, bicubicFilter(factor), true, out);
+}
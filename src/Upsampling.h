@@ -0,0 +1,16 @@
+#pragma once
+
+
+//-------------------------------------------------------------------------------------------------
+// Image Upsampling
+//-------------------------------------------------------------------------------------------------
+
+// Enlarge a grayscale image of width x height pixels by an integer factor. Pixel (x, y) of the
+// output lies at (x / factor, y / factor) in the input, the same position a ray of a scaled
+// rendering starts from, so every factor-th output pixel is an input pixel unchanged.
+// Both filters are separable and run in parallel on the shared thread pool.
+
+void upsampleBilinear(const float *in, int width, int height, int factor, float *out);
+
+// Catmull-Rom; results are clamped to [0.0 .. 1.0], the range of all rendered images
+void upsampleBicubic(const float *in, int width, int height, int factor, float *out);
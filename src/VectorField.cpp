@@ -61,8 +61,12 @@ const int VectorField::size() const
 // VectorField File Loader
 //-------------------------------------------------------------------------------------------------
 
-bool VectorField::loadFromFile(QString filename, QProgressBar* progressBar)
+bool VectorField::loadFromFile(QString filename, Progress* progress)
 {
+	// loaders may run without anyone watching their progress
+	Progress noProgress;
+	if (!progress) progress = &noProgress;
+
 	std::string filenameStr = filename.toStdString();
 	std::ifstream griFile(filenameStr);
 	if (!griFile.is_open())
@@ -71,9 +75,8 @@ bool VectorField::loadFromFile(QString filename, QProgressBar* progressBar)
 		return false;
 	}
 
-	// progress bar
-	progressBar->setRange(0, 100);
-	progressBar->setValue(0);
+	// progress
+	progress->setRange(0, 100);
 
 
 	// --- READ GEOMETRY --- //
@@ -116,8 +119,8 @@ bool VectorField::loadFromFile(QString filename, QProgressBar* progressBar)
 	m_Vectors = new Vector2[m_Size];
 	m_Parameters = new Parameter[m_Size];
 
-	// progress bar
-	progressBar->setValue(20);
+	// progress
+	progress->setValue(20);
 
 
 	// --- READ DATA --- //
@@ -136,8 +139,8 @@ bool VectorField::loadFromFile(QString filename, QProgressBar* progressBar)
 	fread(tmpArray, sizeof(float), dataSize, fp);
 	fclose(fp);
 
-	// progress bar
-	progressBar->setValue(40);
+	// progress
+	progress->setValue(40);
 
 
 	// store vector data
@@ -167,13 +170,15 @@ bool VectorField::loadFromFile(QString filename, QProgressBar* progressBar)
 		m_Vectors[i] = Vector2(vecX, vecY);
 		m_Parameters[i] = parameter;
 
-		// progress bar
-		float progress = ((float)i / float(m_Size)) * 60.0f;
-		progressBar->setValue(40 + progress);
+		// progress, once per grid row
+		if ((i + 1) % m_Width == 0)
+		{
+			progress->setValue(40 + (60LL * (i + 1)) / m_Size);
+		}
 	}
 
-	// progress bar
-	progressBar->setValue(0);
+	// progress
+	progress->setValue(100);
 
 	// delete temporary array
 	delete tmpArray;
@@ -1,12 +1,13 @@
 #pragma once
 
 #include "Vector.h"
+#include "Progress.h"
 
 #include <vector>
 #include <string>
 #include <iostream>
 
-#include <QProgressBar>
+#include <QString>
 
 
 class VectorField
@@ -37,7 +38,7 @@ class VectorField
 
 		// LOAD FROM FILE
 
-		bool							loadFromFile(QString filename, QProgressBar* progressBar);
+		bool							loadFromFile(QString filename, Progress* progress = 0);
 
 
 	private:
@@ -1,8 +1,23 @@
 #include "Volume.h"
+#include "ThreadPool.h"
+#include "VolumeSampler.h"
+#include "Upsampling.h"
+#include "CpuFeatures.h"
+#include "VoxelConversion.h"
+#include "ChunkReader.h"
+#include "BrickFile.h"
+
 #include <glm.hpp>
 #include <gtx/string_cast.hpp>
 #include <gtc/matrix_transform.hpp>
 #include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <climits>
 
 //-------------------------------------------------------------------------------------------------
 // Voxel
@@ -125,28 +140,46 @@ const Voxel Voxel::operator/(const float &value) const
 //-------------------------------------------------------------------------------------------------
 
 Volume::Volume()
-	: m_Width(1), m_Height(1), m_Depth(1), m_Size(0), m_Voxels(1)
+	: m_Voxels16(1), m_Width(1), m_Height(1), m_Depth(1), m_Size(0), m_Stats()
 {
+	m_Data16 = &m_Voxels16.front();
+	buildLookupTable();
 }
 
 Volume::~Volume()
 {
 }
 
-const Voxel& Volume::voxel(const int x, const int y, const int z) const
+const Voxel Volume::voxel(const int x, const int y, const int z) const
 {
-	return m_Voxels[x + y*m_Width + z*m_Width*m_Height];
+	return Voxel(value(x, y, z));
 }
 
-const Voxel& Volume::voxel(const int i) const
+const Voxel Volume::voxel(const long long i) const
 {
-	return m_Voxels[i];
+	const long long slice = (long long)m_Width * m_Height;
+	return Voxel(value(int(i % m_Width), int((i % slice) / m_Width), int(i / slice)));
 }
 
-const Voxel* Volume::voxels() const
+const float Volume::value(const int x, const int y, const int z) const
 {
-	return &(m_Voxels.front());
-};
+	if (m_Cache.isOpen())
+	{
+		return normalizeVoxel(m_Cache.voxel(x, y, z), &m_Lut.front());
+	}
+
+	const size_t i = (m_Layout == LAYOUT_BRICKED) ?
+		BrickLayout(m_Width, m_Height, m_Depth).index(x, y, z) :
+		x + size_t(y) * m_Width + size_t(z) * m_Width * m_Height;
+
+	switch (m_Storage)
+	{
+		case STORAGE_FLOAT:		return m_FloatVoxels[i];
+		case STORAGE_UINT16:	return normalizeVoxel(m_Data16[i], &m_Lut.front());
+		case STORAGE_UINT8:		return normalizeVoxel(m_Voxels8[i], &m_Lut.front());
+	}
+	return 0.0f;
+}
 
 const int Volume::width() const
 {
@@ -163,315 +196,2798 @@ const int Volume::depth() const
 	return m_Depth;
 };
 
-const int Volume::size() const
+const long long Volume::size() const
 {
 	return m_Size;
 };
 
+void Volume::setStorage(Storage storage)
+{
+	m_RequestedStorage = storage;
+}
+
+const Volume::Storage Volume::storage() const
+{
+	return m_RequestedStorage;
+}
+
+void Volume::setMemoryMapped(bool mapped)
+{
+	m_MemoryMapped = mapped;
+}
+
+const bool Volume::memoryMapped() const
+{
+	return m_MemoryMapped;
+}
+
+void Volume::setStreamed(bool streamed)
+{
+	m_Streamed = streamed;
+}
+
+const bool Volume::streamed() const
+{
+	return m_Streamed;
+}
+
+void Volume::setCacheBudget(long long bytes)
+{
+	m_Cache.setBudget(bytes);
+}
+
+const long long Volume::cacheBudget() const
+{
+	return m_Cache.budget();
+}
+
+void Volume::setLayout(Layout layout)
+{
+	m_RequestedLayout = layout;
+}
+
+const Volume::Layout Volume::layout() const
+{
+	return m_RequestedLayout;
+}
+
+void Volume::buildLookupTable()
+{
+	// data is converted to FLOAT values in an interval of [0.0 .. 1.0];
+	// uses 4095.0f to normalize the data, because only 12bit are used for the
+	// data values, and then 4095.0f is the maximum possible value
+	if (m_Storage == STORAGE_UINT8)
+	{
+		m_Lut.resize(256);
+		for (int i = 0; i < 256; i++) m_Lut[i] = float(i) / 255.0f;
+	}
+	else
+	{
+		m_Lut.resize(4096);
+		for (int i = 0; i < 4096; i++) m_Lut[i] = std::fmax(0.0f, std::fmin(1.0f, (float(i) / 4095.0f)));
+	}
+}
+
 
 //-------------------------------------------------------------------------------------------------
 // Volume File Loader
 //-------------------------------------------------------------------------------------------------
 
-bool Volume::loadFromFile(QString filename, QProgressBar* progressBar)
+// Volume files start with their dimensions as three 16bit values, followed by the 16bit voxels,
+// x fastest. Dimensions above 65535 need the extended header: three 16bit zeros, which no
+// valid file of the first kind starts with, and then the dimensions as three 32bit values.
+// Dimensions are limited to BrickLayout::MAX_DIMENSION, so that their brick counts fit an int.
+
+namespace
 {
-	// load file
-	FILE *fp = NULL;
-	fopen_s(&fp, filename.toStdString().c_str(), "rb");
-	if (!fp)
+	struct FileHeader
+	{
+		int					width;
+		int					height;
+		int					depth;
+		long long			dataOffset;		// bytes before the first voxel
+	};
+
+	const int HEADER_BYTES = 3 * sizeof(unsigned short);
+	const int EXTENDED_HEADER_BYTES = 3 * sizeof(unsigned short) + 3 * sizeof(unsigned int);
+
+	// bytes are the first count bytes of the file, all of the extended header if the file has it
+	bool parseHeader(const unsigned char *bytes, const size_t count, FileHeader &header)
+	{
+		if (count < size_t(HEADER_BYTES)) return false;
+
+		unsigned short dimensions16[3];
+		memcpy(dimensions16, bytes, HEADER_BYTES);
+
+		unsigned int dimensions[3] = { dimensions16[0], dimensions16[1], dimensions16[2] };
+		header.dataOffset = HEADER_BYTES;
+
+		if (dimensions[0] == 0 && dimensions[1] == 0 && dimensions[2] == 0)
+		{
+			if (count < size_t(EXTENDED_HEADER_BYTES)) return false;
+
+			memcpy(dimensions, bytes + HEADER_BYTES, sizeof(dimensions));
+			header.dataOffset = EXTENDED_HEADER_BYTES;
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (dimensions[i] == 0 || dimensions[i] > (unsigned int)BrickLayout::MAX_DIMENSION) return false;
+		}
+
+		header.width = int(dimensions[0]);
+		header.height = int(dimensions[1]);
+		header.depth = int(dimensions[2]);
+
+		// the size of the voxel data in bytes has to fit a 64bit file offset
+		const long long slice = (long long)header.width * header.height;
+		return slice <= LLONG_MAX / 4 / header.depth;
+	}
+}
+
+bool Volume::loadFromFile(QString filename, Progress* progress)
+{
+	// loaders may run without anyone watching their progress
+	Progress noProgress;
+	if (!progress) progress = &noProgress;
+
+	// the dataset is loaded into a volume of its own and only replaces this one once it is
+	// complete, so that a failed load leaves this volume as it was
+	Volume loaded;
+	startLoad(loaded);
+
+	if (!loaded.readFile(filename.toStdString(), progress))
 	{
-		std::cerr << "+ Error loading file: " << filename.toStdString() << std::endl;
 		return false;
 	}
 
-	// progress bar
+	adoptDataset(loaded);
+	return true;
+}
+
+bool Volume::readFile(const std::string &filename, Progress *progress)
+{
+	if (m_Streamed)
+	{
+		return openStreamed(filename, progress);
+	}
+
+	if (isBrickFile(filename))
+	{
+		// compressed bricks are always read, also if the file would be mapped otherwise
+		return loadBrickFile(filename, progress);
+	}
+
+	// load file and read the header
+	FILE *fp = NULL;
+	FileHeader header;
+	bool valid = false;
+	long long available = 0;
+
+	if (m_MemoryMapped)
+	{
+		// the whole file is mapped; the OS reads pages only when they are touched
+		if (!m_File.open(filename))
+		{
+			std::cerr << "+ Error loading file: " << filename << std::endl;
+			return false;
+		}
 
-	progressBar->setRange(0, m_Size + 10);
-	progressBar->setValue(0);
+		valid = parseHeader(m_File.data(), m_File.size(), header);
+		available = (long long)m_File.size();
+	}
+	else
+	{
+		fopen_s(&fp, filename.c_str(), "rb");
+		if (!fp)
+		{
+			std::cerr << "+ Error loading file: " << filename << std::endl;
+			return false;
+		}
 
+		unsigned char bytes[EXTENDED_HEADER_BYTES];
+		valid = parseHeader(bytes, fread(bytes, 1, sizeof(bytes), fp), header);
+		available = fileSize(fp);
+		valid = valid && seekFile(fp, header.dataOffset, SEEK_SET) == 0;
+	}
 
-	// read header and set volume dimensions
+	// progress in percent of the stored slices
 
-	unsigned short uWidth, uHeight, uDepth;
-	fread(&uWidth, sizeof(unsigned short), 1, fp);
-	fread(&uHeight, sizeof(unsigned short), 1, fp);
-	fread(&uDepth, sizeof(unsigned short), 1, fp);
-	
-	m_Width = int(uWidth);
-	m_Height = int(uHeight);
-	m_Depth = int(uDepth);
+	progress->setRange(0, 100);
 
-	// check dataset dimensions
-	if (
-			m_Width <= 0 || m_Width > 1000 ||
-			m_Height <= 0 || m_Height > 1000 ||
-			m_Depth <= 0 || m_Depth > 1000)
+	// check dataset dimensions; the file has to hold all of their voxels
+	const long long voxels = valid ? (long long)header.width * header.height * header.depth : 0;
+	if (!valid || available < header.dataOffset + voxels * (long long)sizeof(unsigned short))
 	{
-		std::cerr << "+ Error loading file: " << filename.toStdString() << std::endl;
+		std::cerr << "+ Error loading file: " << filename << std::endl;
 		std::cerr << "Unvalid dimensions - probably loaded .dat flow file instead of .gri file?" << std::endl;
+		if (fp) fclose(fp);
+		m_File.close();
 		return false;
 	}
 
-	// compute dimensions
-	int slice = m_Width * m_Height;
-	m_Size = slice * m_Depth;
-	int test = INT_MAX;
-	m_Voxels.resize(m_Size);
+	m_Width = header.width;
+	m_Height = header.height;
+	m_Depth = header.depth;
+	m_Size = voxels;
 
 	// set sample steps
-	m_samples = round(m_Depth / 5);
+	m_samples = std::max(1, m_Depth / 5);
 	//set alpha opacitie
 	m_transparency = 0.2f;
 
-
 	// read volume data
 
-	// read into vector before writing data into volume to speed up process
-	std::vector<unsigned short> vecData;
-	vecData.resize(m_Size);
-	fread((void*)&(vecData.front()), sizeof(unsigned short), m_Size, fp);
-	fclose(fp);
+	if (m_MemoryMapped)
+	{
+		// voxel data directly follows the header
+		storeVolume((const unsigned short*)(m_File.data() + header.dataOffset), progress);
+	}
+	else
+	{
+		// Chunks are read on a thread of their own while the chunks before are converted,
+		// so that loading takes about as long as the slower of both. 16bit linear storage
+		// keeps the file values, so the chunks are read straight into it.
+		std::vector<float> cellMin, cellMax;
+		startStore(cellMin, cellMax);
+
+		unsigned short *destination = (m_Storage == STORAGE_UINT16 && m_Layout == LAYOUT_LINEAR) ? &m_Voxels16.front() : 0;
+		bool failed = false;
 
-	progressBar->setValue(10);
+		{
+			ChunkReader reader(fp, size_t(m_Width) * m_Height, m_Depth, slicesPerChunk(), CHUNK_BUFFERS, destination);
+			ChunkReader::Chunk chunk;
 
-	// store volume data
+			while (reader.next(chunk))
+			{
+				storeChunk(chunk.voxels, chunk.zBegin, chunk.slices, cellMin, cellMax);
+				reader.release(chunk);
+				progress->setValue(100LL * (chunk.zBegin + chunk.slices) / m_Depth);
+			}
 
-	for (int i = 0; i < m_Size; i++)
-	{
-		// data is converted to FLOAT values in an interval of [0.0 .. 1.0];
-		// uses 4095.0f to normalize the data, because only 12bit are used for the
-		// data values, and then 4095.0f is the maximum possible value
-		const float value = std::fmax(0.0f, std::fmin(1.0f, (float(vecData[i]) / 4095.0f)));
-		m_Voxels[i] = Voxel(value);
-		
-		progressBar->setValue(10 + i);
+			failed = reader.failed();
+		}
+
+		fclose(fp);
+
+		if (failed)
+		{
+			std::cerr << "+ Error loading file: " << filename << std::endl;
+			std::cerr << "File ended before the last slice" << std::endl;
+			return false;
+		}
+
+		finishStore(cellMin, cellMax);
 	}
 
-	progressBar->setValue(0);
+	progress->setValue(100);
 
 	std::cout << "Loaded VOLUME with dimensions " << m_Width << " x " << m_Height << " x " << m_Depth << std::endl;
 
 	return true;
 }
 
+bool Volume::loadFromData(int width, int height, int depth, const std::vector<unsigned short> &voxels, Progress* progress)
+{
+	// loaders may run without anyone watching their progress
+	Progress noProgress;
+	if (!progress) progress = &noProgress;
 
-std::vector<float> Volume::rayCasting()
+	if (width <= 0 || height <= 0 || depth <= 0 || width > BrickLayout::MAX_DIMENSION || height > BrickLayout::MAX_DIMENSION ||
+		depth > BrickLayout::MAX_DIMENSION || voxels.size() != size_t(width) * size_t(height) * size_t(depth))
+	{
+		std::cerr << "+ Error creating volume: data does not match dimensions " << width << " x " << height << " x " << depth << std::endl;
+		return false;
+	}
+
+	progress->setRange(0, 100);
+
+	// stored into a volume of its own like a file, see loadFromFile()
+	Volume loaded;
+	startLoad(loaded);
+
+	loaded.m_Width = width;
+	loaded.m_Height = height;
+	loaded.m_Depth = depth;
+	loaded.m_Size = (long long)width * height * depth;
+
+	loaded.m_samples = std::max(1, depth / 5);
+	loaded.m_transparency = 0.2f;
+
+	loaded.storeVolume(&voxels.front(), progress);
+
+	adoptDataset(loaded);
+
+	progress->setValue(100);
+
+	return true;
+}
+
+void Volume::startLoad(Volume &loaded) const
 {
-	m_factor = 1;
+	loaded.m_Storage = m_RequestedStorage;
+	loaded.m_Layout = m_RequestedLayout;
+	loaded.m_MemoryMapped = m_MemoryMapped;
+	loaded.m_Streamed = m_Streamed;
+	loaded.m_UseLevels = m_UseLevels;
+	loaded.m_Cache.setBudget(m_Cache.budget());
+}
 
-	std::vector<float> out;
-	out.resize(m_Width * m_Height);
+void Volume::adoptDataset(Volume &loaded)
+{
+	// the previous voxels, mapping and bricks go to the loaded volume and are released with it;
+	// swapping keeps m_Data16 pointing into the vector or mapping it was taken from
+	std::swap(m_Storage, loaded.m_Storage);
+	std::swap(m_Layout, loaded.m_Layout);
+	m_FloatVoxels.swap(loaded.m_FloatVoxels);
+	m_Voxels16.swap(loaded.m_Voxels16);
+	m_Voxels8.swap(loaded.m_Voxels8);
+	m_File.swap(loaded.m_File);
+	std::swap(m_Data16, loaded.m_Data16);
+	m_Histogram.swap(loaded.m_Histogram);
+	m_Cache.swap(loaded.m_Cache);
+	m_Lut.swap(loaded.m_Lut);
+
+	m_Width = loaded.m_Width;
+	m_Height = loaded.m_Height;
+	m_Depth = loaded.m_Depth;
+	m_Size = loaded.m_Size;
+	m_samples = loaded.m_samples;
+	m_transparency = loaded.m_transparency;
+
+	m_MacrocellsValid = loaded.m_MacrocellsValid;
+	m_CellsX = loaded.m_CellsX;
+	m_CellsY = loaded.m_CellsY;
+	m_CellsZ = loaded.m_CellsZ;
+	m_CellMin.swap(loaded.m_CellMin);
+	m_CellMax.swap(loaded.m_CellMax);
+
+	m_PyramidValid = loaded.m_PyramidValid;
+	m_MaxLevels.swap(loaded.m_MaxLevels);
+	m_AverageLevels.swap(loaded.m_AverageLevels);
+
+	m_ColumnsValid = false;
+	m_AlphaCacheValid = false;
+}
 
-	for (int x = 0; x < m_Width; x++)
-	{
-		for (int y = 0; y < m_Height; y++)
-		{
-			// intensity
-			Voxel& value = Voxel();
+// Opens a volume file for streaming. Only the header is read; the bricks follow on demand,
+// and the macrocells and the pyramid are built from them on the first frame.
 
-			// Compositions Faktor
-			float alpha = 0.0;
+bool Volume::openStreamed(const std::string &filename, Progress *progress)
+{
+	progress->setRange(0, 100);
 
-			for (int z = 0; z < m_Depth; z += m_samples)
-			{
-				// Maximum-Intensity-Projektion
-				if (mip)
-				{
-					if (this->voxel(x, y, z).operator>(value))
-					{
-						value = this->voxel(x, y, z);
-					}
-				}
+	FILE *fp = NULL;
+	fopen_s(&fp, filename.c_str(), "rb");
 
-				// First-Hit Renderingtechnik
-				if (firstHit)
-				{
-					if (this->voxel(x, y, z).getValue() > 0.f)
-					{
-						value = this->voxel(x, y, z);
-						break;
-					}
-				}
+	// brick files are streamed from their compressed bricks
+	const bool compressed = isBrickFile(filename);
+	FileHeader header;
+	BrickFileHeader bricks;
+	bool valid = false;
 
-				// Average  rendering
-				if (average)
-				{
-					value = value.operator+(this->voxel(x, y, z));
-				}
+	if (fp && compressed)
+	{
+		valid = readBrickFileHeader(fp, bricks);
+		header.width = bricks.width;
+		header.height = bricks.height;
+		header.depth = bricks.depth;
+	}
+	else if (fp)
+	{
+		unsigned char bytes[EXTENDED_HEADER_BYTES];
+		valid = parseHeader(bytes, fread(bytes, 1, sizeof(bytes), fp), header);
+	}
 
-				// Alpha-Compositing
-				else
-				{
-					alpha += this->voxel(x, y, z).getValue() * ((1.0 - z / m_Depth) * m_transparency);
-					
-					if (alpha > 1.0) {
-						alpha = 1.0;
-						break;
-					}
-				}
-			}
+	if (fp) fclose(fp);
 
-			if (average)		  out[y*m_Width + x] = (value.operator/=(m_Depth / m_samples)).getValue();
-			if (alphaCompositing) out[y*m_Width + x] = alpha;
-			else				  out[y*m_Width + x] = value.getValue();
-		}
+	if (!valid)
+	{
+		std::cerr << "+ Error loading file: " << filename << std::endl;
+		return false;
 	}
-	return out;
+
+	const bool opened = compressed ?
+		m_Cache.open(filename, bricks) :
+		m_Cache.open(filename, header.width, header.height, header.depth, header.dataOffset);
+
+	if (!opened)
+	{
+		return false;
+	}
+
+	m_Width = header.width;
+	m_Height = header.height;
+	m_Depth = header.depth;
+	m_Size = (long long)m_Width * m_Height * m_Depth;
+
+	m_samples = std::max(1, m_Depth / 5);
+	m_transparency = 0.2f;
+
+	// the bricks hold the 16bit file values, whatever storage was requested for loading
+	m_Storage = STORAGE_UINT16;
+	m_FloatVoxels.clear();
+	m_Voxels16.clear();
+	m_Voxels8.clear();
+	m_Histogram.clear();
+	buildLookupTable();
+
+	m_MacrocellsValid = false;
+	m_ColumnsValid = false;
+	m_AlphaCacheValid = false;
+	m_PyramidValid = false;
+	m_MaxLevels.clear();
+	m_AverageLevels.clear();
+
+	progress->setValue(100);
+
+	std::cout << "Opened streamed VOLUME with dimensions " << m_Width << " x " << m_Height << " x " << m_Depth
+		<< " (" << m_Cache.budget() / (1024 * 1024) << " MB brick cache)" << std::endl;
+
+	return true;
 }
 
-std::vector<float> Volume::rayCasting2()
+// Loads a brick file slab by slab. The compressed bricks of a slab are one contiguous range of
+// the file, which is read at once; its bricks are decompressed on all threads into the slices
+// of the slab, which are then stored like a chunk of a volume file.
+
+bool Volume::loadBrickFile(const std::string &filename, Progress *progress)
 {
-	float pixel_width = m_Width * m_factor;
-	float pixel_height = m_Height * m_factor;
+	progress->setRange(0, 100);
 
-	std::vector<float> out;
-	out.resize(pixel_width * pixel_height);
+	FILE *fp = NULL;
+	fopen_s(&fp, filename.c_str(), "rb");
 
-	for (int x = 0; x < pixel_width; x++)
+	BrickFileHeader header;
+	if (!fp || !readBrickFileHeader(fp, header))
 	{
-		for (int y = 0; y < pixel_height; y++)
-		{
-			// intensity
-			Voxel& value = Voxel();
+		std::cerr << "+ Error loading file: " << filename << std::endl;
+		std::cerr << "Brick file header or index is damaged" << std::endl;
+		if (fp) fclose(fp);
+		return false;
+	}
 
-			// Compositions Faktor
-			float alpha = 0.0;
+	m_Width = header.width;
+	m_Height = header.height;
+	m_Depth = header.depth;
+	m_Size = (long long)m_Width * m_Height * m_Depth;
 
-			// current voxel
-			Voxel& voxel = Voxel();
+	m_samples = std::max(1, m_Depth / 5);
+	m_transparency = 0.2f;
+
+	std::vector<float> cellMin, cellMax;
+	startStore(cellMin, cellMax);
+
+	// slabs are BRICK slices, whole macrocell layers as storeChunk() needs them
+	const BrickLayout bricks(m_Width, m_Height, m_Depth);
+	const int bricksPerSlab = bricks.bricksX() * bricks.bricksY();
+	const size_t slice = size_t(m_Width) * m_Height;
+
+	std::vector<unsigned char> data;
+	std::vector<unsigned short> slab(slice * BrickLayout::BRICK);
+	std::atomic<bool> broken(false);
+
+	for (int zBegin = 0; zBegin < m_Depth; zBegin += BrickLayout::BRICK)
+	{
+		const int first = (zBegin / BrickLayout::BRICK) * bricksPerSlab;
+		const long long begin = header.offsets[first];
+		data.resize(size_t(header.offsets[first + bricksPerSlab] - begin));
+
+		if (seekFile(fp, begin, SEEK_SET) != 0 || fread(&data.front(), 1, data.size(), fp) != data.size())
+		{
+			broken = true;
+			break;
+		}
 
-			// position in volume
-			float p_x = (float)x / (float)m_factor;
-			float p_y = (float)y / (float)m_factor;
+		const int slices = std::min(int(BrickLayout::BRICK), m_Depth - zBegin);
 
+		ThreadPool::instance().parallelFor(bricksPerSlab, [&](int i)
+		{
+			const int brick = first + i;
+			std::vector<unsigned short> voxels(BrickLayout::BRICK_VOXELS);
 
-			for (int z = 0; z < m_Depth; z += m_samples)
+			if (!decompressBrick(&data[size_t(header.offsets[brick] - begin)], size_t(header.offsets[brick + 1] - header.offsets[brick]), &voxels.front()))
 			{
-				// interpolated voxel
-				if (((float)x / (float)m_factor) != (int)((float)x / (float)m_factor))
-				{
-					voxel = getInterpolatedVoxel(p_x, p_y, z);
-				}
-				else
-				{
-					voxel = this->voxel((int)p_x, (int)p_y, z);
-				}
+				broken = true;
+				return;
+			}
 
-				// Maximum-Intensity-Projektion
-				if (mip)
-				{
-					if (voxel.operator>(value))
-					{
-						value = voxel;
-					}
-				}
+			// the rows of the brick without its padding
+			const int x0 = (i % bricks.bricksX()) * BrickLayout::BRICK;
+			const int y0 = (i / bricks.bricksX()) * BrickLayout::BRICK;
+			const int x1 = std::min(x0 + BrickLayout::BRICK, m_Width);
+			const int y1 = std::min(y0 + BrickLayout::BRICK, m_Height);
 
-				// First-Hit Renderingtechnik
-				if (firstHit)
+			for (int z = zBegin; z < zBegin + slices; z++)
+			{
+				for (int y = y0; y < y1; y++)
 				{
-					if (voxel.getValue() > 0.f)
-					{
-						value = voxel;
-						break;
-					}
+					memcpy(&slab[(z - zBegin) * slice + size_t(y) * m_Width + x0], &voxels[bricks.offset(x0, y, z)], (x1 - x0) * sizeof(unsigned short));
 				}
+			}
+		});
 
-				// Average  rendering
-				if (average)
-				{
-					value = value.operator+(voxel);
-				}
+		if (broken) break;
 
-				// Alpha-Compositing
-				else
-				{
-					alpha += voxel.getValue() * ((1.0 - z / m_Depth) * m_transparency);
+		storeChunk(&slab.front(), zBegin, slices, cellMin, cellMax);
+		progress->setValue(100LL * (zBegin + slices) / m_Depth);
+	}
 
-					if (alpha > 1.0) {
-						alpha = 1.0;
-						break;
-					}
-				}
-			}
+	fclose(fp);
 
-			if (average)		  out[y * pixel_width + x] = (value.operator/=(m_Depth / m_samples)).getValue();
-			if (alphaCompositing) out[y * pixel_width + x] = alpha;
-			else				  out[y * pixel_width + x] = value.getValue();
-		}
+	if (broken)
+	{
+		std::cerr << "+ Error loading file: " << filename << std::endl;
+		std::cerr << "Brick file is damaged or ended before the last brick" << std::endl;
+		return false;
 	}
-	return out;
-}
-Voxel Volume::getInterpolatedVoxel(float x, float y, int z)
-{
-	int x0 = floor(x);
-	int x1 = ceil(x);
-	int y0 = floor(y);
-	int y1 = ceil(y);
 
-	if (x1 == m_Width) x1 = m_Width - 1;
-	if (y1 == m_Height) y1 = m_Height - 1;
+	finishStore(cellMin, cellMax);
 
-	float v1 = this->voxel(x0, y0, z).getValue();
-	float v2 = this->voxel(x1, y0, z).getValue();
-	float v3 = this->voxel(x1, y1, z).getValue();
-	float v4 = this->voxel(x0, y1, z).getValue();
+	progress->setValue(100);
 
-	return Voxel((v1 + v2 + v3  + v4) / 4);
-}
+	std::cout << "Loaded compressed VOLUME with dimensions " << m_Width << " x " << m_Height << " x " << m_Depth << std::endl;
 
-void Volume::setSampleDistance(int distance)
-{
-	m_samples = distance;
+	return true;
 }
 
-void Volume::setScaleFactor(int factor)
-{
-	m_factor = factor;
-}
+// Writes the volume as a brick file. The bricks of a slab are compressed on all threads and
+// then appended in order; the brick index is known at the end and written over the zeros
+// which hold its place after the header.
 
-void Volume::setTransparency(float alpha)
+bool Volume::saveBrickFile(QString filename, Progress* progress)
 {
-	m_transparency = alpha;
-}
+	Progress noProgress;
+	if (!progress) progress = &noProgress;
 
-void Volume::setMip()
-{
-	mip = true;
-	firstHit = false;
-	alphaCompositing = false;
-	average = false;
-}
+	if (!m_Cache.isOpen() && m_Storage != STORAGE_UINT16)
+	{
+		std::cerr << "+ Error saving file: " << filename.toStdString() << std::endl;
+		std::cerr << "Brick files hold the 16bit file values, which only 16bit storage keeps" << std::endl;
+		return false;
+	}
 
-void Volume::setFirstHit()
-{
-	firstHit = true;
-	mip = false;
-	alphaCompositing = false;
-	average = false;
-}
+	FILE *fp = NULL;
+	fopen_s(&fp, filename.toStdString().c_str(), "wb");
+	if (!fp)
+	{
+		std::cerr << "+ Error saving file: " << filename.toStdString() << std::endl;
+		return false;
+	}
 
-void Volume::setAlphaCompositing()
-{
-	alphaCompositing = true;
-	mip = false;
-	firstHit = false;
-	average = false;
-}
+	progress->setRange(0, 100);
 
-void Volume::setAverage()
-{
-	average = true;
-	alphaCompositing = false;
-	mip = false;
-	firstHit = false;
-}
+	const BrickLayout bricks(m_Width, m_Height, m_Depth);
+	const int bricksPerSlab = bricks.bricksX() * bricks.bricksY();
 
-int Volume::getSampleDistance()
-{
-	return m_samples;
-}
+	BrickFileHeader header;
+	header.width = m_Width;
+	header.height = m_Height;
+	header.depth = m_Depth;
+	header.offsets.assign(bricksPerSlab * bricks.bricksZ() + 1, 0);
+	header.offsets[0] = brickFileHeaderSize(bricksPerSlab * bricks.bricksZ());
 
-int Volume::getScaleFactor()
-{
-	return m_factor;
+	bool written = writeBrickFileHeader(fp, header);
+	std::vector<std::vector<unsigned char> > compressed(bricksPerSlab);
+
+	for (int slab = 0; slab < bricks.bricksZ() && written; slab++)
+	{
+		const int first = slab * bricksPerSlab;
+		if (m_Cache.isOpen()) m_Cache.pin(slab);
+
+		ThreadPool::instance().parallelFor(bricksPerSlab, [&](int i)
+		{
+			const int brick = first + i;
+
+			if (m_Cache.isOpen())
+			{
+				compressBrick(m_Cache.bricks()[brick], compressed[i]);
+				return;
+			}
+
+			if (m_Layout == LAYOUT_BRICKED)
+			{
+				compressBrick(m_Data16 + size_t(brick) * BrickLayout::BRICK_VOXELS, compressed[i]);
+				return;
+			}
+
+			// linear voxels are gathered into a brick padded with zeros
+			std::vector<unsigned short> voxels(BrickLayout::BRICK_VOXELS, 0);
+			const int x0 = (i % bricks.bricksX()) * BrickLayout::BRICK;
+			const int y0 = (i / bricks.bricksX()) * BrickLayout::BRICK;
+			const int z0 = slab * BrickLayout::BRICK;
+			const int x1 = std::min(x0 + BrickLayout::BRICK, m_Width);
+			const int y1 = std::min(y0 + BrickLayout::BRICK, m_Height);
+			const int z1 = std::min(z0 + BrickLayout::BRICK, m_Depth);
+
+			for (int z = z0; z < z1; z++)
+			{
+				for (int y = y0; y < y1; y++)
+				{
+					memcpy(&voxels[bricks.offset(x0, y, z)], m_Data16 + x0 + size_t(y) * m_Width + size_t(z) * m_Width * m_Height, (x1 - x0) * sizeof(unsigned short));
+				}
+			}
+
+			compressBrick(&voxels.front(), compressed[i]);
+		});
+
+		if (m_Cache.isOpen()) m_Cache.unpin(slab);
+
+		for (int i = 0; i < bricksPerSlab && written; i++)
+		{
+			written = fwrite(&compressed[i].front(), 1, compressed[i].size(), fp) == compressed[i].size();
+			header.offsets[first + i + 1] = header.offsets[first + i] + (long long)compressed[i].size();
+		}
+
+		progress->setValue(100 * (slab + 1) / bricks.bricksZ());
+	}
+
+	written = written && seekFile(fp, 0, SEEK_SET) == 0 && writeBrickFileHeader(fp, header);
+	written = (fclose(fp) == 0) && written;
+
+	if (!written)
+	{
+		std::cerr << "+ Error saving file: " << filename.toStdString() << std::endl;
+		return false;
+	}
+
+	std::cout << "Saved compressed VOLUME with dimensions " << m_Width << " x " << m_Height << " x " << m_Depth << " in "
+		<< header.offsets.back() << " bytes (" << double(m_Size * sizeof(unsigned short)) / double(header.offsets.back()) << " : 1)" << std::endl;
+
+	return true;
+}
+
+// Stores the 16bit voxels of a dataset in memory, e.g. of a mapped file, in the current storage
+// type and layout.
+
+void Volume::storeVolume(const unsigned short *fileData, Progress *progress)
+{
+	if (m_File.isOpen() && m_Storage == STORAGE_UINT16 && m_Layout == LAYOUT_LINEAR)
+	{
+		// the file data is kept as it is and only normalised when sampled; a mapped file is
+		// used in place without any copy, and not read as a whole here, so that opening it
+		// stays instant
+		m_FloatVoxels.clear();
+		m_Voxels16.clear();
+		m_Voxels8.clear();
+		m_Histogram.clear();
+		m_Data16 = fileData;
+
+		buildLookupTable();
+		m_ColumnsValid = false;
+		m_AlphaCacheValid = false;
+		m_MacrocellsValid = false;
+		m_PyramidValid = false;
+		m_MaxLevels.clear();
+		m_AverageLevels.clear();
+		return;
+	}
+
+	std::vector<float> cellMin, cellMax;
+	startStore(cellMin, cellMax);
+
+	const size_t slice = size_t(m_Width) * m_Height;
+	const int step = slicesPerChunk();
+
+	for (int zBegin = 0; zBegin < m_Depth; zBegin += step)
+	{
+		const int slices = std::min(step, m_Depth - zBegin);
+		storeChunk(fileData + zBegin * slice, zBegin, slices, cellMin, cellMax);
+		progress->setValue(100LL * (zBegin + slices) / m_Depth);
+	}
+
+	// converted data no longer needs the file
+	m_File.close();
+
+	finishStore(cellMin, cellMax);
+}
+
+const int Volume::slicesPerChunk() const
+{
+	const long long layer = (long long)m_Width * m_Height * MACROCELL;
+	return int(std::max(1LL, CHUNK_VOXELS / layer)) * MACROCELL;
+}
+
+void Volume::startStore(std::vector<float> &cellMin, std::vector<float> &cellMax)
+{
+	m_FloatVoxels.clear();
+	m_Voxels16.clear();
+	m_Voxels8.clear();
+	m_Data16 = 0;
+
+	// bricks on the upper borders are padded
+	const size_t stored = (m_Layout == LAYOUT_BRICKED) ? BrickLayout(m_Width, m_Height, m_Depth).size() : size_t(m_Size);
+
+	switch (m_Storage)
+	{
+		case STORAGE_FLOAT:		m_FloatVoxels.assign(stored, 0.0f); break;
+		case STORAGE_UINT16:	m_Voxels16.assign(stored, 0); m_Data16 = &m_Voxels16.front(); break;
+		case STORAGE_UINT8:		m_Voxels8.assign(stored, 0); break;
+	}
+
+	buildLookupTable();
+	m_Histogram.assign(4096, 0);
+
+	m_CellsX = (m_Width + MACROCELL - 1) / MACROCELL;
+	m_CellsY = (m_Height + MACROCELL - 1) / MACROCELL;
+	m_CellsZ = (m_Depth + MACROCELL - 1) / MACROCELL;
+	cellMin.assign(size_t(m_CellsX) * m_CellsY * m_CellsZ, 1.0f);
+	cellMax.assign(size_t(m_CellsX) * m_CellsY * m_CellsZ, 0.0f);
+
+	m_ColumnsValid = false;
+	m_AlphaCacheValid = false;
+	m_MacrocellsValid = false;
+	m_PyramidValid = false;
+	m_MaxLevels.clear();
+	m_AverageLevels.clear();
+}
+
+void Volume::storeChunk(const unsigned short *voxels, int zBegin, int slices, std::vector<float> &cellMin, std::vector<float> &cellMax)
+{
+	switch (m_Storage)
+	{
+		case STORAGE_FLOAT:		storeChunk(voxels, zBegin, slices, &m_FloatVoxels.front(), cellMin, cellMax); break;
+		case STORAGE_UINT16:	storeChunk(voxels, zBegin, slices, &m_Voxels16.front(), cellMin, cellMax); break;
+		case STORAGE_UINT8:		storeChunk(voxels, zBegin, slices, &m_Voxels8.front(), cellMin, cellMax); break;
+	}
+}
+
+template<typename T>
+void Volume::storeChunk(const unsigned short *voxels, int zBegin, int slices, T *target, std::vector<float> &cellMin, std::vector<float> &cellMax)
+{
+	const size_t slice = size_t(m_Width) * m_Height;
+	const bool bricked = m_Layout == LAYOUT_BRICKED;
+	const BrickLayout bricks(m_Width, m_Height, m_Depth);
+	const float *lut = &m_Lut.front();
+
+	const int cellZBegin = zBegin / MACROCELL;
+	const int cellZEnd = (zBegin + slices + MACROCELL - 1) / MACROCELL;
+	std::mutex histogramMutex;
+
+	// Chunks hold whole layers of macrocells. Every task converts the rows of one row of
+	// macrocells and then counts and measures them while they are still in the cache. The
+	// conversions keep the order of the values, so the range of the stored values of a cell
+	// is the conversion of the range of its file values.
+	ThreadPool::instance().parallelFor((cellZEnd - cellZBegin) * m_CellsY, [&](int task)
+	{
+		const int cellZ = cellZBegin + task / m_CellsY;
+		const int cellY = task % m_CellsY;
+		const int z1 = std::min((cellZ + 1) * MACROCELL, m_Depth);
+		const int y1 = std::min((cellY + 1) * MACROCELL, m_Height);
+
+		std::vector<unsigned short> lowest(m_CellsX, 0xFFFF);
+		std::vector<unsigned short> highest(m_CellsX, 0);
+
+		for (int z = cellZ * MACROCELL; z < z1; z++)
+		{
+			for (int y = cellY * MACROCELL; y < y1; y++)
+			{
+				const unsigned short *row = voxels + (z - zBegin) * slice + size_t(y) * m_Width;
+				const size_t offset = z * slice + size_t(y) * m_Width;
+
+				if (bricked)
+				{
+					// every file row is split into the brick rows it crosses
+					for (int x0 = 0; x0 < m_Width; x0 += BrickLayout::BRICK)
+					{
+						convertVoxels(row + x0, target + bricks.index(x0, y, z), std::min(int(BrickLayout::BRICK), m_Width - x0));
+					}
+				}
+				else if ((const void*)(target + offset) != (const void*)row)
+				{
+					convertVoxels(row, target + offset, m_Width);
+				}
+
+				for (int cellX = 0; cellX < m_CellsX; cellX++)
+				{
+					const int x1 = std::min((cellX + 1) * MACROCELL, m_Width);
+					unsigned short low = lowest[cellX];
+					unsigned short high = highest[cellX];
+
+					for (int x = cellX * MACROCELL; x < x1; x++)
+					{
+						low = std::min(low, row[x]);
+						high = std::max(high, row[x]);
+					}
+
+					lowest[cellX] = low;
+					highest[cellX] = high;
+				}
+			}
+		}
+
+		// the histogram of the rows; only the bins between their lowest and highest value
+		// are cleared and merged, and cells of a single value are counted as a whole
+		const unsigned int first = std::min<unsigned int>(*std::min_element(lowest.begin(), lowest.end()), 4095);
+		const unsigned int last = std::min<unsigned int>(*std::max_element(highest.begin(), highest.end()), 4095);
+
+		unsigned int counts[4096];
+		std::fill(counts + first, counts + last + 1, 0);
+
+		for (int cellX = 0; cellX < m_CellsX; cellX++)
+		{
+			const int x0 = cellX * MACROCELL;
+			const int x1 = std::min(x0 + MACROCELL, m_Width);
+
+			if (lowest[cellX] == highest[cellX])
+			{
+				counts[std::min<unsigned int>(lowest[cellX], 4095)] += (x1 - x0) * (y1 - cellY * MACROCELL) * (z1 - cellZ * MACROCELL);
+				continue;
+			}
+
+			for (int z = cellZ * MACROCELL; z < z1; z++)
+			{
+				for (int y = cellY * MACROCELL; y < y1; y++)
+				{
+					const unsigned short *row = voxels + (z - zBegin) * slice + size_t(y) * m_Width;
+					for (int x = x0; x < x1; x++)
+					{
+						counts[std::min<unsigned int>(row[x], 4095)]++;
+					}
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(histogramMutex);
+			for (unsigned int value = first; value <= last; value++)
+			{
+				m_Histogram[value] += counts[value];
+			}
+		}
+
+		const size_t rowCells = (size_t(cellZ) * m_CellsY + cellY) * m_CellsX;
+		for (int cellX = 0; cellX < m_CellsX; cellX++)
+		{
+			T stored;
+			convertVoxel(lowest[cellX], stored);
+			cellMin[rowCells + cellX] = normalizeVoxel(stored, lut);
+			convertVoxel(highest[cellX], stored);
+			cellMax[rowCells + cellX] = normalizeVoxel(stored, lut);
+		}
+	});
+}
+
+void Volume::finishStore(const std::vector<float> &cellMin, const std::vector<float> &cellMax)
+{
+	widenMacrocells(cellMin, cellMax);
+
+	if (m_UseLevels) buildPyramid();
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Volume Samplers
+//-------------------------------------------------------------------------------------------------
+
+// Calls visitor(sampler) with the sampler matching storage type and layout, so that the
+// code behind the visitor is instantiated once per sampler and chosen once per call.
+
+template<class Visitor>
+void Volume::withSampler(Visitor &visitor) const
+{
+	const float *lut = &m_Lut.front();
+
+	if (m_Layout == LAYOUT_BRICKED)
+	{
+		switch (m_Storage)
+		{
+			case STORAGE_FLOAT:		visitor(BrickedSampler<float>(&m_FloatVoxels.front(), lut, m_Width, m_Height, m_Depth)); break;
+			case STORAGE_UINT16:	visitor(BrickedSampler<unsigned short>(m_Data16, lut, m_Width, m_Height, m_Depth)); break;
+			case STORAGE_UINT8:		visitor(BrickedSampler<unsigned char>(&m_Voxels8.front(), lut, m_Width, m_Height, m_Depth)); break;
+		}
+	}
+	else
+	{
+		switch (m_Storage)
+		{
+			case STORAGE_FLOAT:		visitor(LinearSampler<float>(&m_FloatVoxels.front(), lut, m_Width, m_Height, m_Depth)); break;
+			case STORAGE_UINT16:	visitor(LinearSampler<unsigned short>(m_Data16, lut, m_Width, m_Height, m_Depth)); break;
+			case STORAGE_UINT8:		visitor(LinearSampler<unsigned char>(&m_Voxels8.front(), lut, m_Width, m_Height, m_Depth)); break;
+		}
+	}
+}
+
+struct Volume::MacrocellVisitor
+{
+	Volume						&volume;
+
+	template<class Sampler>
+	void operator()(const Sampler &sampler)
+	{
+		volume.buildMacrocells(sampler);
+	}
+};
+
+struct Volume::ColumnVisitor
+{
+	Volume						&volume;
+
+	template<class Sampler>
+	void operator()(const Sampler &sampler)
+	{
+		volume.buildColumnTables(sampler);
+	}
+};
+
+struct Volume::RecastVisitor
+{
+	Volume						&volume;
+	const std::vector<size_t>	&pixels;
+	std::vector<float>			&out;
+	int							pixel_width;
+
+	template<class Sampler>
+	void operator()(const Sampler &sampler)
+	{
+		volume.recastAlpha(sampler, pixels, out, pixel_width);
+	}
+};
+
+struct Volume::PyramidVisitor
+{
+	Volume						&volume;
+	std::vector<unsigned short>	&maxLevel;
+	std::vector<unsigned short>	&averageLevel;
+
+	template<class Sampler>
+	void operator()(const Sampler &sampler)
+	{
+		volume.halveVoxels(sampler, 0, (volume.m_Depth + 1) / 2, maxLevel, averageLevel);
+	}
+};
+
+template<class Compositor>
+struct Volume::RenderVisitor
+{
+	Volume						&volume;
+	std::vector<float>			&out;
+	int							pixel_width;
+	int							pixel_height;
+
+	template<class Sampler>
+	void operator()(const Sampler &sampler)
+	{
+		volume.renderImage<Compositor>(sampler, out, pixel_width, pixel_height);
+	}
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// Volume Macrocells
+//-------------------------------------------------------------------------------------------------
+
+void Volume::buildMacrocells()
+{
+	if (!m_Cache.isOpen())
+	{
+		MacrocellVisitor visitor = { *this };
+		withSampler(visitor);
+		return;
+	}
+
+	// a streamed volume is measured one slab of bricks at a time
+	m_CellsX = (m_Width + MACROCELL - 1) / MACROCELL;
+	m_CellsY = (m_Height + MACROCELL - 1) / MACROCELL;
+	m_CellsZ = (m_Depth + MACROCELL - 1) / MACROCELL;
+
+	const size_t cells = size_t(m_CellsX) * m_CellsY * m_CellsZ;
+	std::vector<float> cellMin(cells, 1.0f);
+	std::vector<float> cellMax(cells, 0.0f);
+
+	const StreamedSampler sampler(m_Cache.bricks(), &m_Lut.front(), m_Width, m_Height, m_Depth);
+	const int slabCells = BrickLayout::BRICK / MACROCELL;
+
+	for (int slab = 0; slab < m_Cache.slabs(); slab++)
+	{
+		m_Cache.pin(slab);
+		measureMacrocells(sampler, slab * slabCells, std::min((slab + 1) * slabCells, m_CellsZ), cellMin, cellMax);
+		m_Cache.unpin(slab);
+	}
+
+	widenMacrocells(cellMin, cellMax);
+}
+
+template<class Sampler>
+void Volume::buildMacrocells(const Sampler &sampler)
+{
+	m_CellsX = (m_Width + MACROCELL - 1) / MACROCELL;
+	m_CellsY = (m_Height + MACROCELL - 1) / MACROCELL;
+	m_CellsZ = (m_Depth + MACROCELL - 1) / MACROCELL;
+
+	const size_t cells = size_t(m_CellsX) * m_CellsY * m_CellsZ;
+	std::vector<float> cellMin(cells, 1.0f);
+	std::vector<float> cellMax(cells, 0.0f);
+
+	measureMacrocells(sampler, 0, m_CellsZ, cellMin, cellMax);
+	widenMacrocells(cellMin, cellMax);
+}
+
+template<class Sampler>
+void Volume::measureMacrocells(const Sampler &sampler, int cellZBegin, int cellZEnd, std::vector<float> &cellMin, std::vector<float> &cellMax)
+{
+	// exact value range of the voxels inside every macrocell, one row of cells per task
+	ThreadPool::instance().parallelFor((cellZEnd - cellZBegin) * m_CellsY, [&](int task)
+	{
+		const int cellZ = cellZBegin + task / m_CellsY;
+		const int cellY = task % m_CellsY;
+
+		float *rowMin = &cellMin[(size_t(cellZ) * m_CellsY + cellY) * m_CellsX];
+		float *rowMax = &cellMax[(size_t(cellZ) * m_CellsY + cellY) * m_CellsX];
+
+		const int z1 = std::min((cellZ + 1) * MACROCELL, m_Depth);
+		const int y1 = std::min((cellY + 1) * MACROCELL, m_Height);
+		for (int z = cellZ * MACROCELL; z < z1; z++)
+		{
+			for (int y = cellY * MACROCELL; y < y1; y++)
+			{
+				for (int x = 0; x < m_Width; x++)
+				{
+					const float value = sampler.value(x, y, z);
+					const int cell = x / MACROCELL;
+
+					if (value < rowMin[cell]) rowMin[cell] = value;
+					if (value > rowMax[cell]) rowMax[cell] = value;
+				}
+			}
+		}
+	});
+}
+
+void Volume::widenMacrocells(const std::vector<float> &cellMin, const std::vector<float> &cellMax)
+{
+	const size_t cellSlice = size_t(m_CellsX) * m_CellsY;
+	const size_t cells = cellSlice * m_CellsZ;
+
+	// Trilinear samples also read the next voxel in x, y and z, so every macrocell is widened
+	// by its upper neighbours. The range then covers every sample whose interpolation starts
+	// inside the cell.
+	m_CellMin.resize(cells);
+	m_CellMax.resize(cells);
+
+	for (int cellZ = 0; cellZ < m_CellsZ; cellZ++)
+	{
+		for (int cellY = 0; cellY < m_CellsY; cellY++)
+		{
+			for (int cellX = 0; cellX < m_CellsX; cellX++)
+			{
+				float minimum = 1.0f;
+				float maximum = 0.0f;
+
+				for (int z = cellZ; z <= std::min(cellZ + 1, m_CellsZ - 1); z++)
+				{
+					for (int y = cellY; y <= std::min(cellY + 1, m_CellsY - 1); y++)
+					{
+						for (int x = cellX; x <= std::min(cellX + 1, m_CellsX - 1); x++)
+						{
+							const size_t cell = x + size_t(y) * m_CellsX + z * cellSlice;
+							minimum = std::min(minimum, cellMin[cell]);
+							maximum = std::max(maximum, cellMax[cell]);
+						}
+					}
+				}
+
+				const size_t cell = cellX + size_t(cellY) * m_CellsX + cellZ * cellSlice;
+				m_CellMin[cell] = minimum;
+				m_CellMax[cell] = maximum;
+			}
+		}
+	}
+
+	m_MacrocellsValid = true;
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Volume Column Tables
+//-------------------------------------------------------------------------------------------------
+
+// Every pixel of an unscaled axis-aligned projection is one fixed z-column of the volume, so
+// MIP, average and first hit only need the maximum, the sum and the first non-zero sample of
+// each column. The tables hold them for one sample distance and give these frames without
+// reading any voxel.
+
+void Volume::buildColumnTables()
+{
+	ColumnVisitor visitor = { *this };
+	withSampler(visitor);
+}
+
+template<class Sampler>
+void Volume::buildColumnTables(const Sampler &sampler)
+{
+	const size_t columns = size_t(m_Width) * m_Height;
+
+	m_ColumnMax.assign(columns, 0.0f);
+	m_ColumnSum.assign(columns, 0.0f);
+	m_ColumnFirst.assign(columns, -1);
+	m_ColumnFirstValue.assign(columns, 0.0f);
+
+	// one row of columns per task, which walks its slices row by row; the samples of each
+	// column are visited in the same order as by the compositors
+	ThreadPool::instance().parallelFor(m_Height, [&](int y)
+	{
+		float *rowMax = &m_ColumnMax[y * size_t(m_Width)];
+		float *rowSum = &m_ColumnSum[y * size_t(m_Width)];
+		int *rowFirst = &m_ColumnFirst[y * size_t(m_Width)];
+		float *rowFirstValue = &m_ColumnFirstValue[y * size_t(m_Width)];
+
+		for (int z = 0; z < m_Depth; z += m_samples)
+		{
+			for (int x = 0; x < m_Width; x++)
+			{
+				const float value = sampler.value(x, y, z);
+
+				if (value > rowMax[x]) rowMax[x] = value;
+				rowSum[x] += value;
+
+				if (rowFirst[x] < 0 && value > 0.f)
+				{
+					rowFirst[x] = z;
+					rowFirstValue[x] = value;
+				}
+			}
+		}
+	});
+
+	m_ColumnSamples = m_samples;
+	m_ColumnsValid = true;
+
+	m_Stats.samples = (long long)columns * ((m_Depth + m_samples - 1) / m_samples);
+}
+
+void Volume::renderFromColumnTables(std::vector<float> &out)
+{
+	const size_t columns = size_t(m_Width) * m_Height;
+
+	if (m_Mode == MIP)
+	{
+		std::copy(m_ColumnMax.begin(), m_ColumnMax.end(), out.begin());
+	}
+	else if (m_Mode == FIRST_HIT)
+	{
+		std::copy(m_ColumnFirstValue.begin(), m_ColumnFirstValue.end(), out.begin());
+	}
+	else if (m_Mode == AVERAGE)
+	{
+		const float count = float((m_Depth + m_samples - 1) / m_samples);
+		for (size_t i = 0; i < columns; i++)
+		{
+			out[i] = m_ColumnSum[i] / count;
+		}
+	}
+
+	m_Stats.reusedPixels = (long long)columns;
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Volume Pyramid
+//-------------------------------------------------------------------------------------------------
+
+// Coarse sample distances do not need every voxel in x and y either. The pyramid keeps the
+// volume at 1/2, 1/4 and 1/8 of its resolution, each level a Volume of its own in the same
+// storage and layout, so that a frame at such a distance is rendered from a level which is
+// 8, 64 or 512 times smaller. MIP and first hit read levels filtered with the maximum, which
+// keep every bright or non-zero voxel visible; average and alpha compositing read averaged
+// levels.
+
+namespace
+{
+	// Halves a volume of 12bit values in every dimension, one output slice of [zBegin .. zEnd)
+	// per task; the outputs have the size of the whole halved volume. Each output voxel covers
+	// up to 2 x 2 x 2 input voxels; the blocks on upper borders of odd dimensions are smaller.
+	// readMax and readAverage give the input voxels of both filters.
+	template<class ReadMax, class ReadAverage>
+	void halveVolume(ReadMax readMax, ReadAverage readAverage, const int width, const int height, const int depth,
+		const int zBegin, const int zEnd, std::vector<unsigned short> &maxOut, std::vector<unsigned short> &averageOut)
+	{
+		const int halfWidth = (width + 1) / 2;
+		const int halfHeight = (height + 1) / 2;
+
+		ThreadPool::instance().parallelFor(zEnd - zBegin, [&](int task)
+		{
+			const int z = zBegin + task;
+			const int z0 = 2 * z;
+			const int z1 = std::min(z0 + 2, depth);
+
+			for (int y = 0; y < halfHeight; y++)
+			{
+				const int y0 = 2 * y;
+				const int y1 = std::min(y0 + 2, height);
+
+				for (int x = 0; x < halfWidth; x++)
+				{
+					const int x0 = 2 * x;
+					const int x1 = std::min(x0 + 2, width);
+
+					unsigned int maximum = 0;
+					unsigned int sum = 0;
+
+					for (int k = z0; k < z1; k++)
+					{
+						for (int j = y0; j < y1; j++)
+						{
+							for (int i = x0; i < x1; i++)
+							{
+								maximum = std::max<unsigned int>(maximum, readMax(i, j, k));
+								sum += readAverage(i, j, k);
+							}
+						}
+					}
+
+					const unsigned int count = (z1 - z0) * (y1 - y0) * (x1 - x0);
+					const size_t index = x + (y + size_t(z) * halfHeight) * halfWidth;
+
+					maxOut[index] = (unsigned short)maximum;
+					averageOut[index] = (unsigned short)((sum + count / 2) / count);
+				}
+			}
+		});
+	}
+}
+
+void Volume::buildPyramid()
+{
+	m_MaxLevels.clear();
+	m_AverageLevels.clear();
+
+	if (m_Width > 1 || m_Height > 1 || m_Depth > 1)
+	{
+		const int halfDepth = (m_Depth + 1) / 2;
+		const size_t halfSize = size_t((m_Width + 1) / 2) * ((m_Height + 1) / 2) * halfDepth;
+
+		std::vector<unsigned short> maxVoxels(halfSize);
+		std::vector<unsigned short> averageVoxels(halfSize);
+
+		if (!m_Cache.isOpen())
+		{
+			PyramidVisitor visitor = { *this, maxVoxels, averageVoxels };
+			withSampler(visitor);
+		}
+		else
+		{
+			// a streamed volume is halved one slab of bricks at a time; slabs have an even
+			// number of slices, so every output slice is made from one slab
+			const StreamedSampler sampler(m_Cache.bricks(), &m_Lut.front(), m_Width, m_Height, m_Depth);
+			const int slabSlices = BrickLayout::BRICK / 2;
+
+			for (int slab = 0; slab < m_Cache.slabs(); slab++)
+			{
+				m_Cache.pin(slab);
+				halveVoxels(sampler, slab * slabSlices, std::min((slab + 1) * slabSlices, halfDepth), maxVoxels, averageVoxels);
+				m_Cache.unpin(slab);
+			}
+		}
+
+		addLevels(maxVoxels, averageVoxels);
+	}
+
+	m_PyramidValid = true;
+
+	std::cout << "Built PYRAMID with " << m_MaxLevels.size() << " levels" << std::endl;
+}
+
+template<class Sampler>
+void Volume::halveVoxels(const Sampler &sampler, int zBegin, int zEnd, std::vector<unsigned short> &maxLevel, std::vector<unsigned short> &averageLevel)
+{
+	// the first level is read through the sampler, so that every storage type and layout
+	// gives the same 12bit values
+	auto read = [&](int x, int y, int z)
+	{
+		return (unsigned short)(sampler.value(x, y, z) * 4095.0f + 0.5f);
+	};
+	halveVolume(read, read, m_Width, m_Height, m_Depth, zBegin, zEnd, maxLevel, averageLevel);
+}
+
+void Volume::addLevels(std::vector<unsigned short> &maxVoxels, std::vector<unsigned short> &averageVoxels)
+{
+	int width = (m_Width + 1) / 2;
+	int height = (m_Height + 1) / 2;
+	int depth = (m_Depth + 1) / 2;
+
+	for (int level = 1; level <= PYRAMID_LEVELS; level++)
+	{
+		std::unique_ptr<Volume> maxVolume(new Volume());
+		maxVolume->setStorage(m_Storage);
+		maxVolume->setLayout(m_Layout);
+		maxVolume->loadFromData(width, height, depth, maxVoxels);
+
+		std::unique_ptr<Volume> averageVolume(new Volume());
+		averageVolume->setStorage(m_Storage);
+		averageVolume->setLayout(m_Layout);
+		averageVolume->loadFromData(width, height, depth, averageVoxels);
+
+		m_MaxLevels.push_back(std::move(maxVolume));
+		m_AverageLevels.push_back(std::move(averageVolume));
+
+		if (level == PYRAMID_LEVELS || (width == 1 && height == 1 && depth == 1)) break;
+
+		// the next level from this one
+		const int halfDepth = (depth + 1) / 2;
+		const size_t halfSize = size_t((width + 1) / 2) * ((height + 1) / 2) * halfDepth;
+
+		std::vector<unsigned short> maxLevel(halfSize);
+		std::vector<unsigned short> averageLevel(halfSize);
+
+		const size_t slice = size_t(width) * height;
+		auto readMax = [&](int x, int y, int z) { return maxVoxels[x + size_t(y) * width + z * slice]; };
+		auto readAverage = [&](int x, int y, int z) { return averageVoxels[x + size_t(y) * width + z * slice]; };
+		halveVolume(readMax, readAverage, width, height, depth, 0, halfDepth, maxLevel, averageLevel);
+
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		depth = halfDepth;
+
+		maxVoxels.swap(maxLevel);
+		averageVoxels.swap(averageLevel);
+	}
+}
+
+// Level L samples every 2^L-th voxel in x, y and z. It is chosen while the sample distance
+// along z is at least as coarse, measured in voxels per pixel of the output image, so that
+// scaled images keep the full resolution longer. Free camera frames always use level 0.
+
+const int Volume::chooseLevel() const
+{
+	if (!m_UseLevels || m_HasCamera) return 0;
+
+	int level = 0;
+	while (level < PYRAMID_LEVELS && (2 << level) * m_factor <= m_samples)
+	{
+		level++;
+	}
+
+	return std::min(level, int(m_MaxLevels.size()));
+}
+
+namespace
+{
+	// copies the top left width x height pixels of an image which is in_width pixels wide
+	void cropImage(const std::vector<float> &in, const int in_width, std::vector<float> &out, const int width, const int height)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const std::vector<float>::const_iterator row = in.begin() + y * size_t(in_width);
+			std::copy(row, row + width, out.begin() + y * size_t(width));
+		}
+	}
+}
+
+// Hands out a coarse level with the render settings of this volume and the sample distance
+// scaled to its voxels; the scale factor is left to the caller.
+
+Volume &Volume::coarseLevel(int level)
+{
+	const bool maximum = m_Mode == MIP || m_Mode == FIRST_HIT;
+	Volume &coarse = maximum ? *m_MaxLevels[level - 1] : *m_AverageLevels[level - 1];
+
+	switch (m_Mode)
+	{
+		case MIP:				coarse.setMip(); break;
+		case FIRST_HIT:			coarse.setFirstHit(); break;
+		case AVERAGE:			coarse.setAverage(); break;
+		case ALPHA_COMPOSITING:	coarse.setAlphaCompositing(); break;
+	}
+
+	coarse.setSampleDistance(std::max(1, m_samples >> level));
+	coarse.setTransparency(m_transparency);
+	coarse.setTerminationThreshold(m_Threshold);
+	coarse.setTraversal(m_Traversal);
+	coarse.setUpsampling(m_Upsampling);
+	coarse.setEmptySpaceSkipping(m_SkipEmptySpace);
+	coarse.setAlphaCache(m_UseAlphaCache);
+	coarse.setCancelFlag(m_Cancel);
+
+	return coarse;
+}
+
+// Renders the frame from a coarse level with the same settings at the resolution of that
+// level, one ray per 2^level x 2^level pixels, which costs about 1/4^level of the rays and
+// 1/8^level of the voxels of a full frame. The image is enlarged by 2^level, bicubic if that
+// is the upsampling of the volume and bilinear otherwise, and cropped to the full image size.
+
+void Volume::renderLevel(int level, std::vector<float> &out)
+{
+	Volume &coarse = coarseLevel(level);
+	coarse.setScaleFactor(m_factor);
+
+	const std::vector<float> image = coarse.rayCasting2();
+	if (image.empty()) return;
+
+	const int coarse_width = coarse.width() * m_factor;
+	const int coarse_height = coarse.height() * m_factor;
+
+	std::vector<float> enlarged(size_t(coarse_width << level) * (coarse_height << level));
+	if (m_Upsampling == UPSAMPLE_BICUBIC)
+	{
+		upsampleBicubic(&image.front(), coarse_width, coarse_height, 1 << level, &enlarged.front());
+	}
+	else
+	{
+		upsampleBilinear(&image.front(), coarse_width, coarse_height, 1 << level, &enlarged.front());
+	}
+	cropImage(enlarged, coarse_width << level, out, m_Width * m_factor, m_Height * m_factor);
+
+	m_Stats = coarse.renderStats();
+	m_Stats.level = level;
+}
+
+// A preview renders from the given level instead of the one the sample distance chooses.
+
+std::vector<float> Volume::rayCastingPreview(int level)
+{
+	if (!m_HasCamera && !m_PyramidValid) buildPyramid();
+
+	level = m_HasCamera ? 0 : std::min(std::max(level, 0), int(m_MaxLevels.size()));
+	if (level == 0) return rayCasting2();
+
+	if (!imageFits()) return std::vector<float>();
+
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	std::vector<float> out;
+	out.resize(size_t(m_Width * m_factor) * (m_Height * m_factor));
+
+	renderLevel(level, out);
+	if (cancelled()) return std::vector<float>();
+
+	const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+	m_Stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	return out;
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Compositing Kernels
+//-------------------------------------------------------------------------------------------------
+
+// Every rendering technique is a small compositor which is handed the samples of one ray
+// front to back. add() returns false as soon as the ray can be terminated. canSkip() tells
+// whether samples up to the given maximum would leave the result unchanged. The ray caster
+// is instantiated once per compositor, so the sampling loop does not test the render mode.
+// PACKET names the same kernel in the AVX2 ray packets, and restore() takes over the state
+// of a packet lane. cache() hands whatever the alpha cache keeps of a ray over to its pixel.
+
+namespace
+{
+	// Maximum-Intensity-Projektion
+	struct MipCompositor
+	{
+		static const PacketCompositing PACKET = PACKET_MIP;
+
+		float value;
+
+		MipCompositor(const float /*transparency*/, const float /*threshold*/, const int /*depth*/, const int /*samples*/)
+			: value(0.0f)
+		{
+		}
+
+		bool add(const float sample, const int /*z*/)
+		{
+			if (sample > value) value = sample;
+			return true;
+		}
+
+		bool canSkip(const float maximum) const
+		{
+			return maximum <= value;
+		}
+
+		float result() const
+		{
+			return value;
+		}
+
+		void restore(const float state)
+		{
+			value = state;
+		}
+
+		void cache(std::vector<std::vector<float> > & /*samples*/, std::vector<char> & /*complete*/, const size_t /*i*/)
+		{
+		}
+	};
+
+	// First-Hit Renderingtechnik
+	struct FirstHitCompositor
+	{
+		static const PacketCompositing PACKET = PACKET_FIRST_HIT;
+
+		float value;
+
+		FirstHitCompositor(const float /*transparency*/, const float /*threshold*/, const int /*depth*/, const int /*samples*/)
+			: value(0.0f)
+		{
+		}
+
+		bool add(const float sample, const int /*z*/)
+		{
+			if (sample > 0.f)
+			{
+				value = sample;
+				return false;
+			}
+			return true;
+		}
+
+		bool canSkip(const float maximum) const
+		{
+			return maximum <= 0.f;
+		}
+
+		float result() const
+		{
+			return value;
+		}
+
+		void restore(const float state)
+		{
+			value = state;
+		}
+
+		void cache(std::vector<std::vector<float> > & /*samples*/, std::vector<char> & /*complete*/, const size_t /*i*/)
+		{
+		}
+	};
+
+	// Average rendering; the rays sample z = 0, samples, 2 * samples, ... below the depth, which
+	// are depth / samples rounded up, at least the one at z = 0
+	struct AverageCompositor
+	{
+		static const PacketCompositing PACKET = PACKET_AVERAGE;
+
+		float sum;
+		float count;
+
+		AverageCompositor(const float /*transparency*/, const float /*threshold*/, const int depth, const int samples)
+			: sum(0.0f), count(float((depth + samples - 1) / samples))
+		{
+		}
+
+		bool add(const float sample, const int /*z*/)
+		{
+			sum += sample;
+			return true;
+		}
+
+		bool canSkip(const float maximum) const
+		{
+			return maximum <= 0.f;
+		}
+
+		float result() const
+		{
+			return sum / count;
+		}
+
+		void restore(const float state)
+		{
+			sum = state;
+		}
+
+		void cache(std::vector<std::vector<float> > & /*samples*/, std::vector<char> & /*complete*/, const size_t /*i*/)
+		{
+		}
+	};
+
+	// Alpha-Compositing
+	//
+	// Front-to-back over operator on the grey values: every sample is as opaque as its value
+	// times the transparency and is seen through the opacity accumulated in front of it. The
+	// ray is terminated once its opacity reaches the threshold, as nothing behind it could
+	// change the pixel by more than the remaining 1 - threshold.
+	struct AlphaCompositor
+	{
+		static const PacketCompositing PACKET = PACKET_ALPHA;
+
+		float color;
+		float opacity;
+		float transparency;
+		float threshold;
+
+		AlphaCompositor(const float transparency, const float threshold, const int /*depth*/, const int /*samples*/)
+			: color(0.0f), opacity(0.0f), transparency(transparency), threshold(threshold)
+		{
+		}
+
+		bool add(const float sample, const int /*z*/)
+		{
+			const float alpha = std::min(1.0f, sample * transparency);
+			const float visible = 1.0f - opacity;
+
+			color += visible * alpha * sample;
+			opacity += visible * alpha;
+
+			return opacity < threshold;
+		}
+
+		bool canSkip(const float maximum) const
+		{
+			return maximum <= 0.f;
+		}
+
+		float result() const
+		{
+			return color;
+		}
+
+		void restore(const float state)
+		{
+			color = state;
+		}
+
+		void cache(std::vector<std::vector<float> > & /*samples*/, std::vector<char> & /*complete*/, const size_t /*i*/)
+		{
+		}
+
+		// Composites the cached samples of a ray; false if the ray would need samples beyond
+		// them. A threshold of zero or less terminates rays on their first sample, zero or
+		// not, so it is never derived.
+		static bool derive(const std::vector<float> &samples, const bool complete, const float transparency, const float threshold, float &result)
+		{
+			if (threshold <= 0.0f) return false;
+
+			AlphaCompositor compositor(transparency, threshold, 1, 1);
+			bool terminated = false;
+
+			for (size_t k = 0; k < samples.size() && !terminated; k++)
+			{
+				terminated = !compositor.add(samples[k], 0);
+			}
+
+			result = compositor.result();
+			return terminated || complete;
+		}
+	};
+
+	// Alpha compositing which keeps the samples of its ray for the alpha cache; only the
+	// non-zero ones, up to where the ray terminates. Packets cannot keep their samples, so
+	// there is no packet kernel.
+	struct RecordingAlphaCompositor : AlphaCompositor
+	{
+		static const PacketCompositing PACKET = PACKET_NONE;
+
+		std::vector<float> recorded;
+		bool terminated;
+
+		RecordingAlphaCompositor(const float transparency, const float threshold, const int depth, const int samples)
+			: AlphaCompositor(transparency, threshold, depth, samples), terminated(false)
+		{
+		}
+
+		bool add(const float sample, const int z)
+		{
+			if (sample != 0.0f) recorded.push_back(sample);
+
+			terminated = !AlphaCompositor::add(sample, z);
+			return !terminated;
+		}
+
+		void cache(std::vector<std::vector<float> > &cached, std::vector<char> &complete, const size_t i)
+		{
+			cached[i].swap(recorded);
+			complete[i] = !terminated;
+		}
+	};
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Volume Ray Casting
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	// rays of a scaled image which do not start on a voxel centre are sampled trilinearly
+	inline bool betweenVoxels(const int x, const int y, const int factor)
+	{
+		return x % factor != 0 || y % factor != 0;
+	}
+}
+
+std::vector<float> Volume::rayCasting()
+{
+	m_factor = 1;
+
+	return rayCasting2();
+}
+
+// The largest image whose rows and columns still fit an int. Coarse levels are enlarged to
+// at most 2^PYRAMID_LEVELS - 1 pixels more than the image in either direction.
+
+const bool Volume::imageFits() const
+{
+	const long long margin = 1LL << PYRAMID_LEVELS;
+	if ((m_Width + margin) * m_factor <= INT_MAX && (m_Height + margin) * m_factor <= INT_MAX) return true;
+
+	std::cerr << "+ Error rendering: " << m_Width << " x " << m_Height << " voxels scaled by " << m_factor
+		<< " need more than " << INT_MAX << " pixels in a row or column" << std::endl;
+	return false;
+}
+
+std::vector<float> Volume::rayCasting2()
+{
+	if (!imageFits()) return std::vector<float>();
+
+	const int pixel_width = m_Width * m_factor;
+	const int pixel_height = m_Height * m_factor;
+
+	std::vector<float> out;
+	out.resize(size_t(pixel_width) * pixel_height);
+
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	// coarse sample distances are rendered from the pyramid
+	if (m_UseLevels && !m_HasCamera && !m_PyramidValid) buildPyramid();
+
+	const int level = chooseLevel();
+	if (level > 0)
+	{
+		renderLevel(level, out);
+		if (cancelled()) return std::vector<float>();
+
+		const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+		m_Stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+		return out;
+	}
+
+	// mapped volumes build their macrocells on the first frame instead of while loading
+	if (!m_MacrocellsValid) buildMacrocells();
+
+	// with image-space upsampling only one ray per voxel column is cast
+	const bool upsample = m_factor > 1 && m_Upsampling != UPSAMPLE_RAYS;
+	const int cast_width = upsample ? m_Width : pixel_width;
+	const int cast_height = upsample ? m_Height : pixel_height;
+
+	std::vector<float> cast;
+	if (upsample) cast.resize(size_t(cast_width) * cast_height);
+	std::vector<float> &target = upsample ? cast : out;
+
+	m_Stats.reusedPixels = 0;
+	m_Stats.rays = 0;
+	m_Stats.averageRayLength = 0.0;
+	m_Stats.level = 0;
+	m_Stats.bricksLoaded = 0;
+
+	// unscaled MIP, average and first hit come straight from the column tables
+	const bool fromTables = m_UseColumnTables && m_Mode != ALPHA_COMPOSITING && !m_HasCamera && !m_Cache.isOpen() &&
+		cast_width == m_Width && cast_height == m_Height;
+
+	if (fromTables)
+	{
+		m_Stats.samples = 0;
+		m_Stats.skippedSamples = 0;
+
+		if (!m_ColumnsValid || m_ColumnSamples != m_samples) buildColumnTables();
+		renderFromColumnTables(target);
+	}
+	else
+	{
+		// choose the compositing kernel once for the whole frame
+		switch (m_Mode)
+		{
+			case MIP:				renderImage<MipCompositor>(target, cast_width, cast_height); break;
+			case FIRST_HIT:			renderImage<FirstHitCompositor>(target, cast_width, cast_height); break;
+			case AVERAGE:			renderImage<AverageCompositor>(target, cast_width, cast_height); break;
+			case ALPHA_COMPOSITING:
+				if (m_UseAlphaCache && !m_HasCamera) renderCachedAlpha(target, cast_width, cast_height);
+				else renderImage<AlphaCompositor>(target, cast_width, cast_height);
+				break;
+		}
+
+		// without early termination every ray covers the whole depth
+		m_Stats.rays = (long long)cast_width * cast_height - m_Stats.reusedPixels;
+		m_Stats.averageRayLength = m_Stats.rays > 0 ? double(m_Stats.samples + m_Stats.skippedSamples) / double(m_Stats.rays) : 0.0;
+	}
+
+	// pixels of tiles or bands which were left out are missing
+	if (cancelled()) return std::vector<float>();
+
+	if (upsample && m_Upsampling == UPSAMPLE_BILINEAR)
+	{
+		upsampleBilinear(&cast.front(), cast_width, cast_height, m_factor, &out.front());
+	}
+	else if (upsample && m_Upsampling == UPSAMPLE_BICUBIC)
+	{
+		upsampleBicubic(&cast.front(), cast_width, cast_height, m_factor, &out.front());
+	}
+
+	const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+	m_Stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	return out;
+}
+
+template<class Compositor>
+void Volume::renderImage(std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	if (m_Cache.isOpen() && m_HasCamera)
+	{
+		std::cerr << "+ Error rendering: the free camera needs a volume in memory, not a streamed one" << std::endl;
+		m_Stats.samples = 0;
+		m_Stats.skippedSamples = 0;
+	}
+	else if (m_Cache.isOpen())
+	{
+		renderStreamed<Compositor>(out, pixel_width, pixel_height);
+	}
+	else
+	{
+		RenderVisitor<Compositor> visitor = { *this, out, pixel_width, pixel_height };
+		withSampler(visitor);
+	}
+}
+
+template<class Compositor, class Sampler>
+void Volume::renderImage(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	// axis-aligned projections run along the z axis, so slice-major order is always possible;
+	// packets need a packet kernel, AVX2 and at least one 32bit word of voxels, but no more
+	// than 32bit indices reach, for their gathers
+	const long long stored = (m_Layout == LAYOUT_BRICKED) ? (long long)BrickLayout(m_Width, m_Height, m_Depth).size() : m_Size;
+	const bool packets = (m_Traversal == RAY_PACKETS || m_Traversal == TRAVERSAL_AUTO) && Compositor::PACKET != PACKET_NONE &&
+		useAvx2() && m_Size >= 4 && stored <= MAX_GATHER_VOXELS;
+
+	if (m_HasCamera)
+	{
+		renderCamera<Compositor>(sampler, out, pixel_width, pixel_height);
+	}
+	else if (packets)
+	{
+		renderPackets<Compositor>(sampler, out, pixel_width, pixel_height);
+	}
+	else if (m_Traversal == RAY_MAJOR || m_Traversal == RAY_PACKETS)
+	{
+		renderRays<Compositor>(sampler, out, pixel_width, pixel_height);
+	}
+	else
+	{
+		renderSlices<Compositor>(sampler, out, pixel_width, pixel_height);
+	}
+}
+
+template<class Compositor, class Sampler>
+void Volume::renderRays(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	// the image is split into tiles which the worker threads take one by one;
+	// every pixel is computed independently, so the result does not depend on the thread count
+	const int tilesX = (pixel_width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesY = (pixel_height + TILE_SIZE - 1) / TILE_SIZE;
+	const int factor = pixel_width / m_Width;
+
+	std::atomic<long long> samples(0);
+	std::atomic<long long> skipped(0);
+
+	ThreadPool::instance().parallelFor(tilesX * tilesY, [&](int tile)
+	{
+		if (cancelled()) return;
+
+		const int x0 = (tile % tilesX) * TILE_SIZE;
+		const int y0 = (tile / tilesX) * TILE_SIZE;
+		const int x1 = std::min(x0 + TILE_SIZE, pixel_width);
+		const int y1 = std::min(y0 + TILE_SIZE, pixel_height);
+
+		long long tileSamples = 0;
+		long long tileSkipped = 0;
+
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = x0; x < x1; x++)
+			{
+				Compositor compositor = betweenVoxels(x, y, factor) ?
+					castRay<Compositor, true>(sampler, x, y, factor, tileSamples, tileSkipped) :
+					castRay<Compositor, false>(sampler, x, y, factor, tileSamples, tileSkipped);
+
+				out[y * size_t(pixel_width) + x] = compositor.result();
+				compositor.cache(m_AlphaSamples, m_AlphaComplete, y * size_t(pixel_width) + x);
+			}
+		}
+
+		samples += tileSamples;
+		skipped += tileSkipped;
+	});
+
+	m_Stats.samples = samples;
+	m_Stats.skippedSamples = skipped;
+}
+
+template<class Compositor, class Sampler>
+void Volume::renderPackets(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	// The tiles of renderRays(), with every row of a tile split into packets of eight rays.
+	// Tiles start at multiples of eight, so only the last pixels of a row which are left over
+	// when the image width is no multiple of eight take the scalar castRay().
+	const int tilesX = (pixel_width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesY = (pixel_height + TILE_SIZE - 1) / TILE_SIZE;
+	const int factor = pixel_width / m_Width;
+
+	const PacketFrame frame = { Compositor::PACKET, m_transparency, m_Threshold, m_samples, factor, m_SkipEmptySpace, &m_CellMax.front(), m_CellsX, m_CellsY, MACROCELL };
+
+	std::atomic<long long> samples(0);
+	std::atomic<long long> skipped(0);
+
+	ThreadPool::instance().parallelFor(tilesX * tilesY, [&](int tile)
+	{
+		if (cancelled()) return;
+
+		const int x0 = (tile % tilesX) * TILE_SIZE;
+		const int y0 = (tile / tilesX) * TILE_SIZE;
+		const int x1 = std::min(x0 + TILE_SIZE, pixel_width);
+		const int y1 = std::min(y0 + TILE_SIZE, pixel_height);
+
+		long long tileSamples = 0;
+		long long tileSkipped = 0;
+
+		for (int y = y0; y < y1; y++)
+		{
+			int x = x0;
+
+			for (; x + 8 <= x1; x += 8)
+			{
+				RayPacket packet;
+				packet.x = x;
+				packet.y = y;
+				sampler.castPacket(frame, packet);
+
+				for (int k = 0; k < 8; k++)
+				{
+					Compositor compositor(m_transparency, m_Threshold, m_Depth, m_samples);
+					compositor.restore(packet.state[k]);
+
+					out[y * size_t(pixel_width) + x + k] = compositor.result();
+				}
+
+				tileSamples += packet.samples;
+				tileSkipped += packet.skipped;
+			}
+
+			for (; x < x1; x++)
+			{
+				Compositor compositor = betweenVoxels(x, y, factor) ?
+					castRay<Compositor, true>(sampler, x, y, factor, tileSamples, tileSkipped) :
+					castRay<Compositor, false>(sampler, x, y, factor, tileSamples, tileSkipped);
+
+				out[y * size_t(pixel_width) + x] = compositor.result();
+				compositor.cache(m_AlphaSamples, m_AlphaComplete, y * size_t(pixel_width) + x);
+			}
+		}
+
+		samples += tileSamples;
+		skipped += tileSkipped;
+	});
+
+	m_Stats.samples = samples;
+	m_Stats.skippedSamples = skipped;
+}
+
+template<class Compositor>
+struct Volume::SliceBand
+{
+	int							y0;
+	int							y1;
+	std::vector<Compositor>		compositors;
+	std::vector<char>			active;
+	size_t						remaining;
+	long long					samples;
+	long long					skipped;
+};
+
+template<class Compositor, class Sampler>
+void Volume::renderSlices(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	std::vector<SliceBand<Compositor> > bands;
+	startSliceBands(bands, pixel_width, pixel_height);
+	renderSliceRange(sampler, bands, pixel_width, 0, m_CellsZ);
+	finishSliceBands(bands, out, pixel_width);
+}
+
+template<class Compositor>
+void Volume::startSliceBands(std::vector<SliceBand<Compositor> > &bands, int pixel_width, int pixel_height)
+{
+	bands.resize((pixel_height + SLICE_BAND - 1) / SLICE_BAND);
+
+	for (size_t band = 0; band < bands.size(); band++)
+	{
+		SliceBand<Compositor> &state = bands[band];
+		state.y0 = int(band) * SLICE_BAND;
+		state.y1 = std::min(state.y0 + SLICE_BAND, pixel_height);
+
+		const size_t pixels = size_t(state.y1 - state.y0) * pixel_width;
+		state.compositors.assign(pixels, Compositor(m_transparency, m_Threshold, m_Depth, m_samples));
+		state.active.assign(pixels, 1);
+		state.remaining = pixels;
+		state.samples = 0;
+		state.skipped = 0;
+	}
+}
+
+template<class Compositor, class Sampler>
+void Volume::renderSliceRange(const Sampler &sampler, std::vector<SliceBand<Compositor> > &bands, int pixel_width, int cellZBegin, int cellZEnd)
+{
+	// Every band of image rows keeps one compositor per pixel and walks the volume slice by
+	// slice, so the voxels are read as sequential rows instead of one voxel per slice and ray.
+	// Each pixel still sees its samples in the same order as in castRay(), which keeps the
+	// image identical to the ray-major traversal.
+	const size_t cellSlice = size_t(m_CellsX) * m_CellsY;
+	const int factor = pixel_width / m_Width;
+
+	// voxel column and interpolation of every image column
+	std::vector<float> positionX(pixel_width);
+	std::vector<int> columnX(pixel_width);
+	std::vector<char> interpolateX(pixel_width);
+	for (int x = 0; x < pixel_width; x++)
+	{
+		positionX[x] = (float)x / (float)factor;
+		columnX[x] = (int)positionX[x];
+		interpolateX[x] = x % factor != 0;
+	}
+
+	ThreadPool::instance().parallelFor(int(bands.size()), [&](int band)
+	{
+		SliceBand<Compositor> &state = bands[band];
+		const int y0 = state.y0;
+		const int y1 = state.y1;
+		const size_t pixels = size_t(y1 - y0) * pixel_width;
+
+		std::vector<Compositor> &compositors = state.compositors;
+		std::vector<char> &active = state.active;
+		std::vector<char> sampled(pixels, 1);
+		size_t &remaining = state.remaining;
+
+		// interpolated samples of one row are collected and taken together
+		std::vector<float> batchX(pixel_width);
+		std::vector<float> batchY(pixel_width);
+		std::vector<float> batchZ(pixel_width);
+		std::vector<float> batchValues(pixel_width);
+		std::vector<int> batchPixels(pixel_width);
+
+		long long bandSamples = 0;
+		long long bandSkipped = 0;
+
+		// the slices are walked in slabs of one macrocell; for every slab each pixel decides
+		// once whether its macrocell can change the result at all
+		for (int cellZ = cellZBegin; cellZ < cellZEnd && remaining > 0 && !cancelled(); cellZ++)
+		{
+			const int slabEnd = std::min((cellZ + 1) * MACROCELL, m_Depth);
+			const int zBegin = (cellZ * MACROCELL + m_samples - 1) / m_samples * m_samples;
+			if (zBegin >= slabEnd) continue;
+
+			const int slabSamples = (slabEnd - zBegin + m_samples - 1) / m_samples;
+			const float *cells = &m_CellMax[cellZ * cellSlice];
+
+			for (int y = y0; y < y1; y++)
+			{
+				const size_t cellRow = size_t((int)((float)y / (float)factor) / MACROCELL) * m_CellsX;
+
+				for (int x = 0; x < pixel_width; x++)
+				{
+					const size_t i = size_t(y - y0) * pixel_width + x;
+
+					sampled[i] = active[i];
+					if (active[i] && m_SkipEmptySpace && compositors[i].canSkip(cells[cellRow + columnX[x] / MACROCELL]))
+					{
+						sampled[i] = 0;
+						bandSkipped += slabSamples;
+					}
+				}
+			}
+
+			for (int z = zBegin; z < slabEnd; z += m_samples)
+			{
+				for (int y = y0; y < y1; y++)
+				{
+					const float p_y = (float)y / (float)factor;
+					const int row = (int)p_y;
+					const bool interpolateY = y % factor != 0;
+
+					Compositor *compositor = &compositors[size_t(y - y0) * pixel_width];
+					char *rowActive = &active[size_t(y - y0) * pixel_width];
+					char *rowSampled = &sampled[size_t(y - y0) * pixel_width];
+
+					int batch = 0;
+
+					for (int x = 0; x < pixel_width; x++)
+					{
+						if (!rowSampled[x]) continue;
+
+						if (interpolateX[x] || interpolateY)
+						{
+							batchX[batch] = positionX[x];
+							batchY[batch] = p_y;
+							batchZ[batch] = (float)z;
+							batchPixels[batch] = x;
+							batch++;
+							continue;
+						}
+
+						bandSamples++;
+
+						if (!compositor[x].add(sampler.value(columnX[x], row, z), z))
+						{
+							rowActive[x] = 0;
+							rowSampled[x] = 0;
+							remaining--;
+						}
+					}
+
+					if (batch == 0) continue;
+
+					sampler.trilinear(&batchX.front(), &batchY.front(), &batchZ.front(), &batchValues.front(), batch);
+					bandSamples += batch;
+
+					for (int k = 0; k < batch; k++)
+					{
+						const int x = batchPixels[k];
+
+						if (!compositor[x].add(batchValues[k], z))
+						{
+							rowActive[x] = 0;
+							rowSampled[x] = 0;
+							remaining--;
+						}
+					}
+				}
+			}
+		}
+
+		state.samples += bandSamples;
+		state.skipped += bandSkipped;
+	});
+}
+
+template<class Compositor>
+void Volume::finishSliceBands(std::vector<SliceBand<Compositor> > &bands, std::vector<float> &out, int pixel_width)
+{
+	m_Stats.samples = 0;
+	m_Stats.skippedSamples = 0;
+
+	for (size_t band = 0; band < bands.size(); band++)
+	{
+		SliceBand<Compositor> &state = bands[band];
+		for (size_t i = 0; i < state.compositors.size(); i++)
+		{
+			out[state.y0 * size_t(pixel_width) + i] = state.compositors[i].result();
+			state.compositors[i].cache(m_AlphaSamples, m_AlphaComplete, state.y0 * size_t(pixel_width) + i);
+		}
+
+		m_Stats.samples += state.samples;
+		m_Stats.skippedSamples += state.skipped;
+	}
+}
+
+// A streamed volume is rendered with the slice-major traversal, one slab of bricks after the
+// other. Interpolated samples also read the first slice of the next slab, which is therefore
+// pinned as well. Slabs whose macrocells are all empty are not read at all, and the walk ends
+// once every ray has terminated.
+
+template<class Compositor>
+void Volume::renderStreamed(std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	std::vector<SliceBand<Compositor> > bands;
+	startSliceBands(bands, pixel_width, pixel_height);
+
+	const StreamedSampler sampler(m_Cache.bricks(), &m_Lut.front(), m_Width, m_Height, m_Depth);
+	const long long loaded = m_Cache.bricksLoaded();
+	const int slabCells = BrickLayout::BRICK / MACROCELL;
+	const size_t cellSlice = size_t(m_CellsX) * m_CellsY;
+
+	for (int slab = 0; slab < m_Cache.slabs(); slab++)
+	{
+		size_t remaining = 0;
+		for (size_t band = 0; band < bands.size(); band++) remaining += bands[band].remaining;
+		if (remaining == 0 || cancelled()) break;
+
+		const int cellZBegin = slab * slabCells;
+		const int cellZEnd = std::min(cellZBegin + slabCells, m_CellsZ);
+
+		// every sample of an empty slab is skipped without reading a voxel
+		const bool empty = m_SkipEmptySpace && *std::max_element(m_CellMax.begin() + cellZBegin * cellSlice, m_CellMax.begin() + cellZEnd * cellSlice) <= 0.0f;
+		const bool next = slab + 1 < m_Cache.slabs();
+
+		if (!empty)
+		{
+			m_Cache.pin(slab);
+			if (next) m_Cache.pin(slab + 1);
+		}
+
+		renderSliceRange(sampler, bands, pixel_width, cellZBegin, cellZEnd);
+
+		if (!empty)
+		{
+			m_Cache.unpin(slab);
+			if (next) m_Cache.unpin(slab + 1);
+		}
+	}
+
+	finishSliceBands(bands, out, pixel_width);
+	m_Stats.bricksLoaded = m_Cache.bricksLoaded() - loaded;
+}
+
+// Alpha compositing frames with the alpha cache: the first frame for a volume, sample distance
+// and image size is cast with the packets, the first one which changes the transparency or the
+// termination threshold records the samples of its rays, and the following ones are composited
+// from them. Once the samples of a frame did not fit, that key is only cast with the packets.
+
+void Volume::renderCachedAlpha(std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	const bool sameKey = m_AlphaCacheValid && m_AlphaCacheSamples == m_samples &&
+		m_AlphaCacheWidth == pixel_width && m_AlphaCacheHeight == pixel_height;
+
+	if (!sameKey)
+	{
+		std::vector<std::vector<float> >().swap(m_AlphaSamples);
+		std::vector<char>().swap(m_AlphaComplete);
+
+		m_AlphaCacheValid = true;
+		m_AlphaCacheState = ALPHA_UNRECORDED;
+		m_AlphaCacheSamples = m_samples;
+		m_AlphaCacheWidth = pixel_width;
+		m_AlphaCacheHeight = pixel_height;
+		m_AlphaCacheTransparency = m_transparency;
+		m_AlphaCacheThreshold = m_Threshold;
+	}
+
+	const bool changed = m_AlphaCacheTransparency != m_transparency || m_AlphaCacheThreshold != m_Threshold;
+
+	switch (m_AlphaCacheState)
+	{
+		case ALPHA_UNRECORDED:
+			if (changed) recordAlpha(out, pixel_width, pixel_height);
+			else renderImage<AlphaCompositor>(out, pixel_width, pixel_height);
+			break;
+		case ALPHA_RECORDED:
+			deriveAlpha(out, pixel_width, pixel_height);
+			break;
+		case ALPHA_OVERFLOWED:
+			renderImage<AlphaCompositor>(out, pixel_width, pixel_height);
+			break;
+	}
+
+	// a cancelled frame may have recorded only some of its rays
+	if (cancelled())
+	{
+		m_AlphaCacheValid = false;
+		return;
+	}
+
+	trimAlphaCache();
+}
+
+void Volume::recordAlpha(std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	const size_t pixels = size_t(pixel_width) * pixel_height;
+
+	m_AlphaSamples.clear();
+	m_AlphaSamples.resize(pixels);
+	m_AlphaComplete.assign(pixels, 0);
+
+	renderImage<RecordingAlphaCompositor>(out, pixel_width, pixel_height);
+	m_AlphaCacheState = ALPHA_RECORDED;
+}
+
+void Volume::deriveAlpha(std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	// one pass over the cached samples; rays which would run beyond them are collected per
+	// chunk of pixels and cast again afterwards
+	const size_t pixels = size_t(pixel_width) * pixel_height;
+	const int chunks = int((pixels + RECAST_CHUNK - 1) / RECAST_CHUNK);
+	std::vector<std::vector<size_t> > chunkRecasts(chunks);
+
+	ThreadPool::instance().parallelFor(chunks, [&](int chunk)
+	{
+		const size_t end = std::min(pixels, size_t(chunk + 1) * RECAST_CHUNK);
+
+		for (size_t i = size_t(chunk) * RECAST_CHUNK; i < end; i++)
+		{
+			if (!AlphaCompositor::derive(m_AlphaSamples[i], m_AlphaComplete[i] != 0, m_transparency, m_Threshold, out[i]))
+			{
+				chunkRecasts[chunk].push_back(i);
+			}
+		}
+	});
+
+	std::vector<size_t> recast;
+	for (int chunk = 0; chunk < chunks; chunk++)
+	{
+		recast.insert(recast.end(), chunkRecasts[chunk].begin(), chunkRecasts[chunk].end());
+	}
+
+	m_Stats.samples = 0;
+	m_Stats.skippedSamples = 0;
+	m_Stats.reusedPixels = (long long)(pixels - recast.size());
+
+	if (recast.empty()) return;
+
+	if (m_Cache.isOpen())
+	{
+		// streamed volumes only read whole slabs, so the frame is recorded again
+		recordAlpha(out, pixel_width, pixel_height);
+		m_Stats.reusedPixels = 0;
+		return;
+	}
+
+	RecastVisitor visitor = { *this, recast, out, pixel_width };
+	withSampler(visitor);
+}
+
+template<class Sampler>
+void Volume::recastAlpha(const Sampler &sampler, const std::vector<size_t> &pixels, std::vector<float> &out, int pixel_width)
+{
+	const int factor = pixel_width / m_Width;
+	const size_t count = pixels.size();
+	const int chunks = int((count + RECAST_CHUNK - 1) / RECAST_CHUNK);
+
+	std::atomic<long long> samples(0);
+	std::atomic<long long> skipped(0);
+
+	ThreadPool::instance().parallelFor(chunks, [&](int chunk)
+	{
+		if (cancelled()) return;
+
+		long long chunkSamples = 0;
+		long long chunkSkipped = 0;
+
+		const size_t end = std::min(count, size_t(chunk + 1) * RECAST_CHUNK);
+
+		for (size_t k = size_t(chunk) * RECAST_CHUNK; k < end; k++)
+		{
+			const size_t i = pixels[k];
+			const int x = int(i % pixel_width);
+			const int y = int(i / pixel_width);
+
+			RecordingAlphaCompositor compositor = betweenVoxels(x, y, factor) ?
+				castRay<RecordingAlphaCompositor, true>(sampler, x, y, factor, chunkSamples, chunkSkipped) :
+				castRay<RecordingAlphaCompositor, false>(sampler, x, y, factor, chunkSamples, chunkSkipped);
+
+			out[i] = compositor.result();
+			compositor.cache(m_AlphaSamples, m_AlphaComplete, i);
+		}
+
+		samples += chunkSamples;
+		skipped += chunkSkipped;
+	});
+
+	m_Stats.samples = samples;
+	m_Stats.skippedSamples = skipped;
+}
+
+void Volume::trimAlphaCache()
+{
+	// rays which hardly terminate on large images may keep more samples than are worth it
+	long long bytes = 0;
+	for (size_t i = 0; i < m_AlphaSamples.size(); i++)
+	{
+		bytes += (long long)m_AlphaSamples[i].size() * sizeof(float);
+	}
+
+	if (bytes > ALPHA_CACHE_BYTES)
+	{
+		// recording them again for the same key would only be thrown away again
+		std::vector<std::vector<float> >().swap(m_AlphaSamples);
+		std::vector<char>().swap(m_AlphaComplete);
+		m_AlphaCacheState = ALPHA_OVERFLOWED;
+	}
+}
+
+template<class Compositor, bool Interpolate, class Sampler>
+Compositor Volume::castRay(const Sampler &sampler, int x, int y, int factor, long long &samples, long long &skipped) const
+{
+	Compositor compositor(m_transparency, m_Threshold, m_Depth, m_samples);
+
+	// position in volume
+	const float p_x = (float)x / (float)factor;
+	const float p_y = (float)y / (float)factor;
+
+	// voxel column of the ray when no interpolation is needed
+	const int column_x = (int)p_x;
+	const int column_y = (int)p_y;
+
+	// macrocells along the ray
+	const float *cells = &m_CellMax[column_x / MACROCELL + size_t(column_y / MACROCELL) * m_CellsX];
+	const size_t cellSlice = size_t(m_CellsX) * m_CellsY;
+
+	int z = 0;
+	while (z < m_Depth)
+	{
+		const int cellZ = z / MACROCELL;
+		const int cellEnd = std::min((cellZ + 1) * MACROCELL, m_Depth);
+
+		// jump over all samples of a macrocell which cannot change the result
+		if (m_SkipEmptySpace && compositor.canSkip(cells[cellZ * cellSlice]))
+		{
+			const int steps = (cellEnd - z + m_samples - 1) / m_samples;
+			z += steps * m_samples;
+			skipped += steps;
+			continue;
+		}
+
+		if (!Interpolate)
+		{
+			for (; z < cellEnd; z += m_samples)
+			{
+				samples++;
+
+				if (!compositor.add(sampler.value(column_x, column_y, z), z))
+				{
+					return compositor;
+				}
+			}
+
+			continue;
+		}
+
+		// interpolated samples of the cell are taken eight at a time and composited in order
+		float positionX[8] = { p_x, p_x, p_x, p_x, p_x, p_x, p_x, p_x };
+		float positionY[8] = { p_y, p_y, p_y, p_y, p_y, p_y, p_y, p_y };
+		float positionZ[8];
+		float values[8];
+
+		while (z < cellEnd)
+		{
+			int count = 0;
+			for (; count < 8 && z + count * m_samples < cellEnd; count++)
+			{
+				positionZ[count] = (float)(z + count * m_samples);
+			}
+
+			sampler.trilinear(positionX, positionY, positionZ, values, count);
+
+			for (int k = 0; k < count; k++, z += m_samples)
+			{
+				samples++;
+
+				if (!compositor.add(values[k], z))
+				{
+					return compositor;
+				}
+			}
+		}
+	}
+
+	return compositor;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Volume Camera Ray Casting
+//-------------------------------------------------------------------------------------------------
+
+// Rays of a free camera start on the near plane and end on the far plane of the projection.
+// Each ray is clipped against the bounding box of the voxels and sampled with m_StepLength
+// between the entry and the exit point only. Samples are interpolated trilinearly.
+
+template<class Compositor, class Sampler>
+void Volume::renderCamera(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height)
+{
+	const glm::mat4 inverse = glm::inverse(m_Projection * m_View);
+
+	// world space is the voxel grid centred at the origin; rays are traced in voxel space
+	const glm::vec3 center(0.5f * (m_Width - 1), 0.5f * (m_Height - 1), 0.5f * (m_Depth - 1));
+	const glm::vec3 boxMin(-0.5f);
+	const glm::vec3 boxMax(m_Width - 0.5f, m_Height - 0.5f, m_Depth - 0.5f);
+
+	const int tilesX = (pixel_width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesY = (pixel_height + TILE_SIZE - 1) / TILE_SIZE;
+
+	std::atomic<long long> samples(0);
+	std::atomic<long long> skipped(0);
+
+	ThreadPool::instance().parallelFor(tilesX * tilesY, [&](int tile)
+	{
+		if (cancelled()) return;
+
+		const int x0 = (tile % tilesX) * TILE_SIZE;
+		const int y0 = (tile / tilesX) * TILE_SIZE;
+		const int x1 = std::min(x0 + TILE_SIZE, pixel_width);
+		const int y1 = std::min(y0 + TILE_SIZE, pixel_height);
+
+		long long tileSamples = 0;
+		long long tileSkipped = 0;
+
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = x0; x < x1; x++)
+			{
+				// pixel centre in normalised device coordinates, unprojected to both planes
+				const float ndcX = 2.0f * (x + 0.5f) / pixel_width - 1.0f;
+				const float ndcY = 2.0f * (y + 0.5f) / pixel_height - 1.0f;
+
+				const glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+				const glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+
+				const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w + center;
+				const glm::vec3 end = glm::vec3(farPoint) / farPoint.w + center;
+
+				const float length = glm::length(end - origin);
+				const glm::vec3 direction = (end - origin) / length;
+
+				// slab test against the bounding box, limited to the segment between the planes
+				float tEnter = 0.0f;
+				float tExit = length;
+
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (direction[axis] == 0.0f)
+					{
+						if (origin[axis] < boxMin[axis] || origin[axis] > boxMax[axis]) tExit = -1.0f;
+						continue;
+					}
+
+					const float t0 = (boxMin[axis] - origin[axis]) / direction[axis];
+					const float t1 = (boxMax[axis] - origin[axis]) / direction[axis];
+					tEnter = std::max(tEnter, std::min(t0, t1));
+					tExit = std::min(tExit, std::max(t0, t1));
+				}
+
+				out[y * size_t(pixel_width) + x] = (tEnter <= tExit) ?
+					castCameraRay<Compositor>(sampler, origin, direction, tEnter, tExit, tileSamples, tileSkipped).result() :
+					Compositor(m_transparency, m_Threshold, 1, 1).result();
+			}
+		}
+
+		samples += tileSamples;
+		skipped += tileSkipped;
+	});
+
+	m_Stats.samples = samples;
+	m_Stats.skippedSamples = skipped;
+}
+
+template<class Compositor, class Sampler>
+Compositor Volume::castCameraRay(const Sampler &sampler, const glm::vec3 &origin, const glm::vec3 &direction, float tEnter, float tExit, long long &samples, long long &skipped) const
+{
+	// samples sit in the middle of the steps the clipped segment is divided into
+	const int steps = std::max(1, int((tExit - tEnter) / m_StepLength + 0.5f));
+
+	// every step is one sample, so average divides by the samples inside the volume
+	Compositor compositor(m_transparency, m_Threshold, steps, 1);
+
+	const size_t cellSlice = size_t(m_CellsX) * m_CellsY;
+
+	float positionX[8];
+	float positionY[8];
+	float positionZ[8];
+	float values[8];
+
+	int i = 0;
+	while (i < steps)
+	{
+		const glm::vec3 p = origin + direction * (tEnter + (i + 0.5f) * m_StepLength);
+
+		// jump to the first step behind a macrocell which cannot change the result; the cell
+		// of a sample is the one of the lower corner of its interpolation
+		const int cellX = std::max(0, std::min(m_Width - 1, (int)floor(p.x))) / MACROCELL;
+		const int cellY = std::max(0, std::min(m_Height - 1, (int)floor(p.y))) / MACROCELL;
+		const int cellZ = std::max(0, std::min(m_Depth - 1, (int)floor(p.z))) / MACROCELL;
+
+		if (m_SkipEmptySpace && compositor.canSkip(m_CellMax[cellX + size_t(cellY) * m_CellsX + cellZ * cellSlice]))
+		{
+			const glm::vec3 cellMin(cellX * MACROCELL, cellY * MACROCELL, cellZ * MACROCELL);
+			const glm::vec3 cellMax(
+				std::min((cellX + 1) * MACROCELL, m_Width),
+				std::min((cellY + 1) * MACROCELL, m_Height),
+				std::min((cellZ + 1) * MACROCELL, m_Depth));
+
+			float tCell = tExit;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (direction[axis] > 0.0f) tCell = std::min(tCell, (cellMax[axis] - origin[axis]) / direction[axis]);
+				else if (direction[axis] < 0.0f) tCell = std::min(tCell, (cellMin[axis] - origin[axis]) / direction[axis]);
+			}
+
+			const int next = std::min(steps, std::max(i + 1, (int)ceil((tCell - tEnter) / m_StepLength - 0.5f)));
+			skipped += next - i;
+			i = next;
+			continue;
+		}
+
+		// the following steps are sampled eight at a time and composited in order
+		const int count = std::min(8, steps - i);
+		for (int k = 0; k < count; k++)
+		{
+			const glm::vec3 q = origin + direction * (tEnter + (i + k + 0.5f) * m_StepLength);
+			positionX[k] = q.x;
+			positionY[k] = q.y;
+			positionZ[k] = q.z;
+		}
+
+		sampler.trilinear(positionX, positionY, positionZ, values, count);
+
+		for (int k = 0; k < count; k++, i++)
+		{
+			samples++;
+
+			if (!compositor.add(values[k], i))
+			{
+				return compositor;
+			}
+		}
+	}
+
+	return compositor;
+}
+
+
+void Volume::setCancelFlag(const std::atomic<bool> *cancel)
+{
+	m_Cancel = cancel;
+}
+
+const bool Volume::cancelled() const
+{
+	return m_Cancel && m_Cancel->load(std::memory_order_relaxed);
+}
+
+void Volume::setSampleDistance(int distance)
+{
+	m_samples = std::max(1, distance);
+}
+
+void Volume::setScaleFactor(int factor)
+{
+	m_factor = factor;
+}
+
+void Volume::setTransparency(float alpha)
+{
+	m_transparency = alpha;
+}
+
+void Volume::setTerminationThreshold(float threshold)
+{
+	m_Threshold = threshold;
+}
+
+const float Volume::terminationThreshold() const
+{
+	return m_Threshold;
+}
+
+void Volume::setMip()
+{
+	m_Mode = MIP;
+}
+
+void Volume::setFirstHit()
+{
+	m_Mode = FIRST_HIT;
+}
+
+void Volume::setAlphaCompositing()
+{
+	m_Mode = ALPHA_COMPOSITING;
+}
+
+void Volume::setAverage()
+{
+	m_Mode = AVERAGE;
+}
+
+int Volume::getSampleDistance()
+{
+	return m_samples;
+}
+
+int Volume::getScaleFactor()
+{
+	return m_factor;
+}
+
+const Volume::RenderMode Volume::renderMode() const
+{
+	return m_Mode;
+}
+
+void Volume::setTraversal(Traversal traversal)
+{
+	m_Traversal = traversal;
+}
+
+const Volume::Traversal Volume::traversal() const
+{
+	return m_Traversal;
+}
+
+void Volume::setUpsampling(Upsampling upsampling)
+{
+	m_Upsampling = upsampling;
+}
+
+const Volume::Upsampling Volume::upsampling() const
+{
+	return m_Upsampling;
+}
+
+void Volume::setColumnTables(bool use)
+{
+	m_UseColumnTables = use;
+}
+
+const bool Volume::columnTables() const
+{
+	return m_UseColumnTables;
+}
+
+void Volume::setAlphaCache(bool use)
+{
+	m_UseAlphaCache = use;
+
+	if (!use)
+	{
+		std::vector<std::vector<float> >().swap(m_AlphaSamples);
+		std::vector<char>().swap(m_AlphaComplete);
+		m_AlphaCacheValid = false;
+	}
+}
+
+const bool Volume::alphaCache() const
+{
+	return m_UseAlphaCache;
+}
+
+void Volume::setCamera(const glm::mat4 &view, const glm::mat4 &projection)
+{
+	m_View = view;
+	m_Projection = projection;
+	m_HasCamera = true;
+}
+
+void Volume::clearCamera()
+{
+	m_HasCamera = false;
+}
+
+const bool Volume::isAxisAligned() const
+{
+	return !m_HasCamera;
+}
+
+void Volume::setStepLength(float length)
+{
+	m_StepLength = length;
+}
+
+const float Volume::stepLength() const
+{
+	return m_StepLength;
+}
+
+void Volume::setLevelOfDetail(bool use)
+{
+	m_UseLevels = use;
+}
+
+const bool Volume::levelOfDetail() const
+{
+	return m_UseLevels;
+}
+
+const int Volume::levels()
+{
+	if (m_HasCamera) return 0;
+
+	if (!m_PyramidValid) buildPyramid();
+	return int(m_MaxLevels.size());
+}
+
+void Volume::setEmptySpaceSkipping(bool skip)
+{
+	m_SkipEmptySpace = skip;
+}
+
+const bool Volume::emptySpaceSkipping() const
+{
+	return m_SkipEmptySpace;
+}
+
+const Volume::RenderStats& Volume::renderStats() const
+{
+	return m_Stats;
+}
+
+const std::vector<long long>& Volume::histogram() const
+{
+	return m_Histogram;
 }
\ No newline at end of file
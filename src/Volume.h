@@ -1,12 +1,19 @@
 #pragma once
 
 #include "Vector.h"
+#include "MappedFile.h"
+#include "BrickCache.h"
+#include "Progress.h"
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <atomic>
 #include <iostream>
 
-#include <QProgressBar>
+#include <QString>
+
+#include <glm.hpp>
 
 
 //-------------------------------------------------------------------------------------------------
@@ -66,24 +73,130 @@ class Volume
 		Volume();
 		~Volume();
 
+		// RENDERING TECHNIQUES
+
+		enum RenderMode
+		{
+			MIP						= 0,
+			FIRST_HIT				= 1,
+			AVERAGE					= 2,
+			ALPHA_COMPOSITING		= 3
+		};
+
+		// order in which the volume is walked for axis-aligned projections
+		enum Traversal
+		{
+			TRAVERSAL_AUTO			= 0,		// ray packets with AVX2, else slice-major
+			RAY_MAJOR				= 1,		// one whole ray after the other
+			SLICE_MAJOR				= 2,		// one whole slice after the other
+			RAY_PACKETS				= 3			// eight neighbouring rays at once with AVX2, else ray-major
+		};
+
+		// type in which the voxels are kept in memory
+		enum Storage
+		{
+			STORAGE_FLOAT			= 0,		// normalised FLOAT values, 4 bytes per voxel
+			STORAGE_UINT16			= 1,		// 12bit values as read from file, 2 bytes per voxel
+			STORAGE_UINT8			= 2			// values rescaled to 8bit, 1 byte per voxel
+		};
+
+		// order of the voxels in memory
+		enum Layout
+		{
+			LAYOUT_LINEAR			= 0,		// one x-fastest array as in the file
+			LAYOUT_BRICKED			= 1			// bricks of 32^3 voxels, each contiguous
+		};
+
+		// how images with a scale factor above 1 are produced
+		enum Upsampling
+		{
+			UPSAMPLE_RAYS			= 0,		// one ray per output pixel
+			UPSAMPLE_BILINEAR		= 1,		// one ray per voxel column, then bilinear upsampling
+			UPSAMPLE_BICUBIC		= 2			// one ray per voxel column, then bicubic upsampling
+		};
+
+		// statistics of the last rendered frame
+		struct RenderStats
+		{
+			long long		samples;			// voxel samples taken along all rays
+			long long		skippedSamples;		// samples left out by empty-space skipping
+			long long		reusedPixels;		// pixels taken from column tables or the alpha cache without casting
+			long long		rays;				// rays cast, one per pixel of the cast image which was not reused
+			double			averageRayLength;	// samples taken or skipped per ray until it ended
+			int				level;				// pyramid level the frame was rendered from, 0 is full resolution
+			long long		bricksLoaded;		// bricks read from disk for the frame, streamed volumes only
+			double			milliseconds;		// wall-clock time of the frame
+		};
+
 		// VOLUME DATA
 
-		const Voxel&			voxel(const int i) const;
-		const Voxel&			voxel(const int x, const int y, const int z) const;
-		const Voxel*			voxels() const;
+		const Voxel				voxel(const long long i) const;
+		const Voxel				voxel(const int x, const int y, const int z) const;
 
 		const int				width() const;
 		const int				height() const;
 		const int				depth() const;
 
-		const int				size() const;
+		const long long			size() const;
+
+		// storage used by the next loadFromFile() or loadFromData(); the voxels already loaded
+		// keep theirs, and streamed volumes always keep the 16bit file values
+		void					setStorage(Storage storage);
+		const Storage			storage() const;
+
+		// layout used by the next loadFromFile() or loadFromData(); the voxels already loaded
+		// keep theirs
+		void					setLayout(Layout layout);
+		const Layout			layout() const;
+
+		// map the file instead of reading it; 16bit storage then uses the file data in place
+		void					setMemoryMapped(bool mapped);
+		const bool				memoryMapped() const;
+
+		// keep only the bricks needed by the current slab in memory and read them from the file
+		// while rendering; for volumes larger than the memory. Streamed volumes keep the 16bit
+		// file values and are rendered slice-major along z; the free camera needs a volume in memory.
+		void					setStreamed(bool streamed);
+		const bool				streamed() const;
+
+		// memory for the bricks of a streamed volume in bytes
+		void					setCacheBudget(long long bytes);
+		const long long			cacheBudget() const;
+
+		// files hold three 16bit dimensions, or three 16bit zeros and three 32bit dimensions for
+		// volumes of more than 65535 voxels along an axis, followed by the 16bit voxels, x fastest.
+		// Brick files of BrickFile.h are recognised by their header and decompressed on all threads.
+		// A load which fails leaves the volume unchanged.
+		bool					loadFromFile(QString filename, Progress* progress = 0);
+
+		// writes the 16bit voxels as a brick file; needs 16bit storage or a streamed volume
+		bool					saveBrickFile(QString filename, Progress* progress = 0);
 
-		bool					loadFromFile(QString filename, QProgressBar* progressBar);
+		// creates the volume from 16bit voxels in memory, x fastest, e.g. a generated dataset
+		bool					loadFromData(int width, int height, int depth, const std::vector<unsigned short> &voxels, Progress* progress = 0);
 		std::vector<float>		rayCasting();
+
+		// the frame scaled by the scale factor; empty if the image has more than INT_MAX rows
+		// or columns
 		std::vector<float>		rayCasting2();
 
+		// the frame at 1/2^level of its resolution from the pyramid, enlarged to full size;
+		// level 0 renders the full frame
+		std::vector<float>		rayCastingPreview(int level);
+
+		// rayCasting2() and rayCastingPreview() stop at the next image tile, band of rows or slab
+		// once *cancel is true, and return an empty image instead of the unfinished one; null
+		// renders every frame to its end
+		void					setCancelFlag(const std::atomic<bool> *cancel);
+
+		// distances below 1 are taken as 1
 		void					setSampleDistance(int distance);
 		void					setTransparency(float alpha);
+
+		// alpha compositing terminates a ray once its opacity reaches the threshold
+		void					setTerminationThreshold(float threshold);
+		const float				terminationThreshold() const;
+
 		void					setMip();
 		void					setFirstHit();
 		void					setAlphaCompositing();
@@ -91,24 +204,317 @@ class Volume
 		int						getSampleDistance();
 		void					setScaleFactor(int factor);
 		int						getScaleFactor();
+		const RenderMode		renderMode() const;
+		void					setTraversal(Traversal traversal);
+		const Traversal			traversal() const;
+		void					setUpsampling(Upsampling upsampling);
+		const Upsampling		upsampling() const;
+
+		// CAMERA
+
+		// free orthographic or perspective camera; world space is the voxel grid centred at
+		// the origin with one unit per voxel. Without a camera the volume is projected along z.
+		void					setCamera(const glm::mat4 &view, const glm::mat4 &projection);
+		void					clearCamera();
+		const bool				isAxisAligned() const;
+
+		// distance between two samples along a camera ray, in voxels
+		void					setStepLength(float length);
+		const float				stepLength() const;
+
+		// precompute per-column maximum, sum and first hit for unscaled MIP, average and first hit
+		void					setColumnTables(bool use);
+		const bool				columnTables() const;
+
+		// keep the samples of every alpha compositing ray, so that a frame which only changes
+		// the transparency or the termination threshold is composited again without sampling
+		void					setAlphaCache(bool use);
+		const bool				alphaCache() const;
+
+		// LEVEL OF DETAIL
+
+		// coarse levels below the full resolution, each half the size of the one before
+		static const int		PYRAMID_LEVELS = 3;
+
+		// render coarse sample distances from a pyramid of 1/2, 1/4 and 1/8 resolution, at the
+		// resolution of the level and enlarged to full size; the pyramid is built on loading, or
+		// on the first frame which needs it
+		void					setLevelOfDetail(bool use);
+		const bool				levelOfDetail() const;
+
+		// coarse levels below the full resolution which rayCastingPreview() renders from, built
+		// first if needed; small volumes may stop before PYRAMID_LEVELS, and the free camera
+		// has none
+		const int				levels();
+
+		// jump over macrocells whose voxels cannot change the result of a ray
+		void					setEmptySpaceSkipping(bool skip);
+		const bool				emptySpaceSkipping() const;
+		const RenderStats&		renderStats() const;
+
+		// number of voxels of every 12bit value, larger values counted as 4095; collected while
+		// loading, empty for streamed volumes and mapped files used in place
+		const std::vector<long long>&	histogram() const;
 
 	private:
 
-		std::vector<Voxel>		m_Voxels;
+		// files are read and stored in chunks of whole macrocell layers with about this many
+		// voxels; the reader runs ahead by at most CHUNK_BUFFERS chunks
+		static const int		CHUNK_VOXELS = 1 << 22;
+		static const int		CHUNK_BUFFERS = 3;
+
+		// storage and layout which setStorage() and setLayout() ask for, taken by the next load
+		Storage					m_RequestedStorage = STORAGE_UINT16;
+		Layout					m_RequestedLayout = LAYOUT_LINEAR;
+
+		// voxel data in the storage and layout it was loaded with, only the vector of the
+		// current storage type is filled
+		Storage					m_Storage = STORAGE_UINT16;
+		Layout					m_Layout = LAYOUT_LINEAR;
+		std::vector<float>		m_FloatVoxels;
+		std::vector<unsigned short>	m_Voxels16;
+		std::vector<unsigned char>	m_Voxels8;
+
+		// 16bit voxels, either m_Voxels16 or the data of the mapped file
+		bool					m_MemoryMapped = false;
+		MappedFile				m_File;
+		const unsigned short	*m_Data16;
+
+		std::vector<long long>	m_Histogram;
+
+		// bricks of a streamed volume; open instead of any voxel vector
+		bool					m_Streamed = false;
+		BrickCache				m_Cache;
+
+		bool					openStreamed(const std::string &filename, Progress *progress);
+		bool					loadBrickFile(const std::string &filename, Progress *progress);
+
+		// Loaders read into a fresh volume: startLoad() gives it the storage settings of this one,
+		// readFile() loads a file into it, and adoptDataset() takes over its dataset once complete.
+		void					startLoad(Volume &loaded) const;
+		bool					readFile(const std::string &filename, Progress *progress);
+		void					adoptDataset(Volume &loaded);
+
+		// normalisation table of the integer storage types
+		std::vector<float>		m_Lut;
+
 		int						m_Width;
 		int						m_Height;
 		int						m_Depth;
 
-		int						m_Size;
+		long long				m_Size;
 		int						m_samples;
 		float				    m_transparency;
+		float					m_Threshold = 0.99f;
 		int						m_factor = 1;
 
-		bool					mip = true;
-		bool					firstHit = false;
-		bool					alphaCompositing = false;
-		bool					average = false;
+		RenderMode				m_Mode = MIP;
+		Traversal				m_Traversal = TRAVERSAL_AUTO;
+		Upsampling				m_Upsampling = UPSAMPLE_RAYS;
+		RenderStats				m_Stats;
+
+		// set by another thread to abandon the frame in progress
+		const std::atomic<bool>	*m_Cancel = nullptr;
+		const bool				cancelled() const;
+
+		// MACROCELLS
+
+		// edge length in voxels of the cells of the min/max grid
+		static const int		MACROCELL = 8;
+
+		bool					m_SkipEmptySpace = true;
+		bool					m_MacrocellsValid = false;
+		int						m_CellsX;
+		int						m_CellsY;
+		int						m_CellsZ;
+		std::vector<float>		m_CellMin;
+		std::vector<float>		m_CellMax;
+
+		void					buildMacrocells();
+
+		template<class Sampler>
+		void					buildMacrocells(const Sampler &sampler);
+
+		// exact value range of the macrocells in the slabs [cellZBegin .. cellZEnd)
+		template<class Sampler>
+		void					measureMacrocells(const Sampler &sampler, int cellZBegin, int cellZEnd, std::vector<float> &cellMin, std::vector<float> &cellMax);
+
+		void					widenMacrocells(const std::vector<float> &cellMin, const std::vector<float> &cellMax);
+
+		// COLUMN TABLES
+
+		// maximum, sum and first non-zero sample (z and value, z is -1 if there is none) of
+		// every z-column, taken with the sample distance m_ColumnSamples
+		bool					m_UseColumnTables = false;
+		bool					m_ColumnsValid = false;
+		int						m_ColumnSamples;
+		std::vector<float>		m_ColumnMax;
+		std::vector<float>		m_ColumnSum;
+		std::vector<int>		m_ColumnFirst;
+		std::vector<float>		m_ColumnFirstValue;
+
+		void					buildColumnTables();
+
+		template<class Sampler>
+		void					buildColumnTables(const Sampler &sampler);
+
+		void					renderFromColumnTables(std::vector<float> &out);
+
+		// PYRAMID
+
+		// levels 1 .. n as volumes of their own, filtered with the maximum for MIP and first
+		// hit and with the average for average and alpha compositing
+		bool					m_UseLevels = false;
+		bool					m_PyramidValid = false;
+		std::vector<std::unique_ptr<Volume> >	m_MaxLevels;
+		std::vector<std::unique_ptr<Volume> >	m_AverageLevels;
+
+		void					buildPyramid();
+
+		// the first level from the voxels of the slices [2 * zBegin .. 2 * zEnd)
+		template<class Sampler>
+		void					halveVoxels(const Sampler &sampler, int zBegin, int zEnd, std::vector<unsigned short> &maxLevel, std::vector<unsigned short> &averageLevel);
+
+		// level volumes from the first level and every coarser one halved from it
+		void					addLevels(std::vector<unsigned short> &maxVoxels, std::vector<unsigned short> &averageVoxels);
+
+		const int				chooseLevel() const;
+		Volume					&coarseLevel(int level);
+		void					renderLevel(int level, std::vector<float> &out);
+
+		// CAMERA
+
+		bool					m_HasCamera = false;
+		glm::mat4				m_View;
+		glm::mat4				m_Projection;
+		float					m_StepLength = 1.0f;
+
+		template<class Compositor, class Sampler>
+		void					renderCamera(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height);
+
+		template<class Compositor, class Sampler>
+		Compositor				castCameraRay(const Sampler &sampler, const glm::vec3 &origin, const glm::vec3 &direction, float tEnter, float tExit, long long &samples, long long &skipped) const;
+
+		// ALPHA COMPOSITING CACHE
+
+		// cached samples above this size are dropped again
+		static const long long	ALPHA_CACHE_BYTES = 512LL << 20;
+
+		// pixels composited again per task
+		static const int		RECAST_CHUNK = 256;
+
+		// what the alpha cache holds for the volume, sample distance and image size of the last
+		// alpha compositing frame
+		enum AlphaCacheState
+		{
+			ALPHA_UNRECORDED		= 0,		// nothing yet, frames are cast with the packets
+			ALPHA_RECORDED			= 1,		// the samples of every ray
+			ALPHA_OVERFLOWED		= 2			// more samples than ALPHA_CACHE_BYTES, never recorded again
+		};
+
+		// The non-zero samples of every ray of the last alpha compositing frame, in order and up
+		// to where the ray terminated, and whether the ray ran through the whole volume. Zero
+		// samples leave colour and opacity unchanged, so every ray which either ran to its end
+		// or terminates within its samples for the new settings is composited from them alone;
+		// only the others are cast again. Recording is scalar, so it only starts once the
+		// transparency or the termination threshold changes for the same volume, sample
+		// distance and image size; m_AlphaCacheValid tells whether those are still the same.
+		bool					m_UseAlphaCache = false;
+		bool					m_AlphaCacheValid = false;
+		AlphaCacheState			m_AlphaCacheState = ALPHA_UNRECORDED;
+		int						m_AlphaCacheSamples;
+		int						m_AlphaCacheWidth;
+		int						m_AlphaCacheHeight;
+		float					m_AlphaCacheTransparency;
+		float					m_AlphaCacheThreshold;
+		std::vector<std::vector<float> >	m_AlphaSamples;
+		std::vector<char>		m_AlphaComplete;
+
+		void					renderCachedAlpha(std::vector<float> &out, int pixel_width, int pixel_height);
+		void					recordAlpha(std::vector<float> &out, int pixel_width, int pixel_height);
+		void					deriveAlpha(std::vector<float> &out, int pixel_width, int pixel_height);
+		void					trimAlphaCache();
+
+		template<class Sampler>
+		void					recastAlpha(const Sampler &sampler, const std::vector<size_t> &pixels, std::vector<float> &out, int pixel_width);
+
+		// RAY CASTING
+
+		// edge length in pixels of the image tiles rendered in parallel
+		static const int		TILE_SIZE = 64;
+
+		// rows of pixels which share one pass through the slices in slice-major order
+		static const int		SLICE_BAND = 16;
+
+		// image rows and columns are counted in int, pixels in size_t; false with an error if the
+		// scaled image, or a coarse level enlarged to cover it, has more columns or rows than that
+		const bool				imageFits() const;
+
+		// renders the whole image with one compositing kernel and one voxel sampler,
+		// both chosen once per frame
+		template<class Compositor>
+		void					renderImage(std::vector<float> &out, int pixel_width, int pixel_height);
+
+		template<class Compositor, class Sampler>
+		void					renderImage(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height);
+
+		template<class Compositor, class Sampler>
+		void					renderRays(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height);
+
+		template<class Compositor, class Sampler>
+		void					renderSlices(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height);
+
+		// compositors of a band of image rows in slice-major order, kept from one range of
+		// slices to the next
+		template<class Compositor>
+		struct					SliceBand;
+
+		template<class Compositor>
+		void					startSliceBands(std::vector<SliceBand<Compositor> > &bands, int pixel_width, int pixel_height);
+
+		template<class Compositor, class Sampler>
+		void					renderSliceRange(const Sampler &sampler, std::vector<SliceBand<Compositor> > &bands, int pixel_width, int cellZBegin, int cellZEnd);
+
+		template<class Compositor>
+		void					finishSliceBands(std::vector<SliceBand<Compositor> > &bands, std::vector<float> &out, int pixel_width);
+
+		// slice-major rendering of a streamed volume, one slab of bricks at a time
+		template<class Compositor>
+		void					renderStreamed(std::vector<float> &out, int pixel_width, int pixel_height);
+
+		template<class Compositor, class Sampler>
+		void					renderPackets(const Sampler &sampler, std::vector<float> &out, int pixel_width, int pixel_height);
+
+		template<class Compositor, bool Interpolate, class Sampler>
+		Compositor				castRay(const Sampler &sampler, int x, int y, int factor, long long &samples, long long &skipped) const;
+
+		const float				value(const int x, const int y, const int z) const;
+		void					buildLookupTable();
+
+		void					storeVolume(const unsigned short *fileData, Progress *progress);
+
+		// Storing a volume chunk by chunk: startStore() allocates the storage, storeChunk()
+		// converts the slices [zBegin .. zBegin + slices), counts their values and measures their
+		// macrocells into cellMin and cellMax, and finishStore() builds what needs all voxels.
+		const int				slicesPerChunk() const;
+		void					startStore(std::vector<float> &cellMin, std::vector<float> &cellMax);
+		void					storeChunk(const unsigned short *voxels, int zBegin, int slices, std::vector<float> &cellMin, std::vector<float> &cellMax);
+		void					finishStore(const std::vector<float> &cellMin, const std::vector<float> &cellMax);
+
+		template<typename T>
+		void					storeChunk(const unsigned short *voxels, int zBegin, int slices, T *target, std::vector<float> &cellMin, std::vector<float> &cellMax);
+
+		// VOXEL SAMPLERS
+
+		template<class Visitor>
+		void					withSampler(Visitor &visitor) const;
+
+		struct					MacrocellVisitor;
+		struct					ColumnVisitor;
+		struct					PyramidVisitor;
+		struct					RecastVisitor;
 
-		Voxel					getInterpolatedVoxel(float x, float y, int z);
+		template<class Compositor>
+		struct					RenderVisitor;
 
 };
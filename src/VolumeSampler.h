@@ -0,0 +1,321 @@
+#pragma once
+
+#include "CpuFeatures.h"
+#include "TrilinearAvx2.h"
+#include "PacketAvx2.h"
+#include "BrickConstants.h"
+
+#include <math.h>
+#include <algorithm>
+#include <climits>
+
+
+//-------------------------------------------------------------------------------------------------
+// Voxel Normalisation
+//-------------------------------------------------------------------------------------------------
+
+// Voxels are kept in their stored type and only converted to FLOAT values in an interval of
+// [0.0 .. 1.0] when they are sampled. Integer types are looked up in a normalisation table
+// with one entry per value; 16bit values above 4095 are clamped to the last (12bit) entry.
+
+inline float normalizeVoxel(const float value, const float * /*lut*/)
+{
+	return value;
+}
+
+inline float normalizeVoxel(const unsigned short value, const float *lut)
+{
+	return lut[value < 4095 ? value : 4095];
+}
+
+inline float normalizeVoxel(const unsigned char value, const float *lut)
+{
+	return lut[value];
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// Interpolation
+//-------------------------------------------------------------------------------------------------
+
+inline float interpolateLinear(const float a, const float b, const float t)
+{
+	return a + (b - a) * t;
+}
+
+// Trilinear interpolation at (x, y, z), read through any sampler. Positions are clamped to the
+// voxel centres of the volume, so samples up to half a voxel outside take the border value.
+// trilinearAvx2() blends in exactly this order and gives the same values.
+
+template<class Sampler>
+inline float interpolateTrilinear(const Sampler &sampler, float x, float y, float z, const int width, const int height, const int depth)
+{
+	x = std::min(std::max(x, 0.0f), float(width - 1));
+	y = std::min(std::max(y, 0.0f), float(height - 1));
+	z = std::min(std::max(z, 0.0f), float(depth - 1));
+
+	// lower corner, upper corner and fraction along every axis
+	const int x0 = (int)x;
+	const int y0 = (int)y;
+	const int z0 = (int)z;
+	const int x1 = std::min(x0 + 1, width - 1);
+	const int y1 = std::min(y0 + 1, height - 1);
+	const int z1 = std::min(z0 + 1, depth - 1);
+	const float fx = x - (float)x0;
+	const float fy = y - (float)y0;
+	const float fz = z - (float)z0;
+
+	const float c00 = interpolateLinear(sampler.value(x0, y0, z0), sampler.value(x1, y0, z0), fx);
+	const float c10 = interpolateLinear(sampler.value(x0, y1, z0), sampler.value(x1, y1, z0), fx);
+	const float c01 = interpolateLinear(sampler.value(x0, y0, z1), sampler.value(x1, y0, z1), fx);
+	const float c11 = interpolateLinear(sampler.value(x0, y1, z1), sampler.value(x1, y1, z1), fx);
+
+	const float c0 = interpolateLinear(c00, c10, fy);
+	const float c1 = interpolateLinear(c01, c11, fy);
+
+	return interpolateLinear(c0, c1, fz);
+}
+
+// Trilinear samples at count positions; groups of eight go through the AVX2 kernel when the
+// CPU has it, the rest through the scalar code.
+
+template<class Sampler, typename T>
+inline void interpolateTrilinear(const Sampler &sampler, const T *data, const float *lut, const VoxelGrid &grid, const float *x, const float *y, const float *z, float *values, int count)
+{
+	int i = useAvx2() ? trilinearAvx2(data, lut, grid, x, y, z, values, count) : 0;
+
+	for (; i < count; i++)
+	{
+		values[i] = interpolateTrilinear(sampler, x[i], y[i], z[i], grid.width, grid.height, grid.depth);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------------------
+// LinearSampler
+//-------------------------------------------------------------------------------------------------
+
+// reads voxels of type T from one x-fastest array
+
+template<typename T>
+class LinearSampler
+{
+
+	public:
+
+		LinearSampler(const T *data, const float *lut, const int width, const int height, const int depth)
+			: m_Data(data), m_Lut(lut), m_Width(width), m_Height(height), m_Depth(depth), m_Slice(size_t(width) * height)
+		{
+			const VoxelGrid grid = { width, height, depth, (long long)m_Slice * depth, false };
+			m_Grid = grid;
+		}
+
+		float value(const int x, const int y, const int z) const
+		{
+			return normalizeVoxel(m_Data[x + size_t(y) * m_Width + z * m_Slice], m_Lut);
+		}
+
+		float trilinear(const float x, const float y, const float z) const
+		{
+			return interpolateTrilinear(*this, x, y, z, m_Width, m_Height, m_Depth);
+		}
+
+		void trilinear(const float *x, const float *y, const float *z, float *values, int count) const
+		{
+			interpolateTrilinear(*this, m_Data, m_Lut, m_Grid, x, y, z, values, count);
+		}
+
+		// eight rays at once; only when useAvx2() is true
+		void castPacket(const PacketFrame &frame, RayPacket &packet) const
+		{
+			castPacketAvx2(m_Data, m_Lut, m_Grid, frame, packet);
+		}
+
+	private:
+
+		const T					*m_Data;
+		const float				*m_Lut;
+
+		int						m_Width;
+		int						m_Height;
+		int						m_Depth;
+		size_t					m_Slice;
+
+		VoxelGrid				m_Grid;
+
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// BrickLayout
+//-------------------------------------------------------------------------------------------------
+
+// Voxel addressing of a volume stored as bricks of 32^3 voxels. Each brick is contiguous in
+// memory (x fastest inside the brick), bricks follow each other x, y, z fastest. Bricks on
+// the upper borders are padded up to the full brick size. Bricks are counted in 32bit,
+// voxel indices need 64bit.
+
+class BrickLayout : public BrickConstants
+{
+
+	public:
+
+		// largest width, height or depth whose rounding up to whole bricks still fits an int
+		static const int		MAX_DIMENSION = INT_MAX - BRICK + 1;
+
+		BrickLayout(const int width, const int height, const int depth)
+			: m_BricksX((width + BRICK - 1) >> BRICK_SHIFT),
+			  m_BricksY((height + BRICK - 1) >> BRICK_SHIFT),
+			  m_BricksZ((depth + BRICK - 1) >> BRICK_SHIFT)
+		{
+		}
+
+		size_t index(const int x, const int y, const int z) const
+		{
+			return (size_t(brick(x, y, z)) << (3 * BRICK_SHIFT)) | offset(x, y, z);
+		}
+
+		// brick of a voxel and its offset inside the brick
+		int brick(const int x, const int y, const int z) const
+		{
+			return (x >> BRICK_SHIFT) + ((y >> BRICK_SHIFT) + (z >> BRICK_SHIFT) * m_BricksY) * m_BricksX;
+		}
+
+		int offset(const int x, const int y, const int z) const
+		{
+			return (x & BRICK_MASK) | ((y & BRICK_MASK) << BRICK_SHIFT) | ((z & BRICK_MASK) << (2 * BRICK_SHIFT));
+		}
+
+		// number of stored voxels including the padding
+		size_t size() const
+		{
+			return size_t(m_BricksX) * m_BricksY * m_BricksZ * BRICK_VOXELS;
+		}
+
+		// number of bricks along every axis
+		int bricksX() const
+		{
+			return m_BricksX;
+		}
+
+		int bricksY() const
+		{
+			return m_BricksY;
+		}
+
+		int bricksZ() const
+		{
+			return m_BricksZ;
+		}
+
+	private:
+
+		int						m_BricksX;
+		int						m_BricksY;
+		int						m_BricksZ;
+
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// BrickedSampler
+//-------------------------------------------------------------------------------------------------
+
+// reads voxels of type T from a bricked array
+
+template<typename T>
+class BrickedSampler
+{
+
+	public:
+
+		BrickedSampler(const T *data, const float *lut, const int width, const int height, const int depth)
+			: m_Data(data), m_Lut(lut), m_Layout(width, height, depth), m_Width(width), m_Height(height), m_Depth(depth)
+		{
+			const VoxelGrid grid = { width, height, depth, (long long)m_Layout.size(), true };
+			m_Grid = grid;
+		}
+
+		float value(const int x, const int y, const int z) const
+		{
+			return normalizeVoxel(m_Data[m_Layout.index(x, y, z)], m_Lut);
+		}
+
+		float trilinear(const float x, const float y, const float z) const
+		{
+			return interpolateTrilinear(*this, x, y, z, m_Width, m_Height, m_Depth);
+		}
+
+		void trilinear(const float *x, const float *y, const float *z, float *values, int count) const
+		{
+			interpolateTrilinear(*this, m_Data, m_Lut, m_Grid, x, y, z, values, count);
+		}
+
+		// eight rays at once; only when useAvx2() is true
+		void castPacket(const PacketFrame &frame, RayPacket &packet) const
+		{
+			castPacketAvx2(m_Data, m_Lut, m_Grid, frame, packet);
+		}
+
+	private:
+
+		const T					*m_Data;
+		const float				*m_Lut;
+
+		BrickLayout				m_Layout;
+		int						m_Width;
+		int						m_Height;
+		int						m_Depth;
+
+		VoxelGrid				m_Grid;
+
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// StreamedSampler
+//-------------------------------------------------------------------------------------------------
+
+// reads 16bit voxels from the bricks a BrickCache holds in memory; bricks is its brick table
+// and only the voxels of pinned slabs may be read
+
+class StreamedSampler
+{
+
+	public:
+
+		StreamedSampler(const unsigned short *const *bricks, const float *lut, const int width, const int height, const int depth)
+			: m_Bricks(bricks), m_Lut(lut), m_Layout(width, height, depth), m_Width(width), m_Height(height), m_Depth(depth)
+		{
+		}
+
+		float value(const int x, const int y, const int z) const
+		{
+			return normalizeVoxel(m_Bricks[m_Layout.brick(x, y, z)][m_Layout.offset(x, y, z)], m_Lut);
+		}
+
+		float trilinear(const float x, const float y, const float z) const
+		{
+			return interpolateTrilinear(*this, x, y, z, m_Width, m_Height, m_Depth);
+		}
+
+		// the bricks are no contiguous array, so there is no AVX2 gather
+		void trilinear(const float *x, const float *y, const float *z, float *values, int count) const
+		{
+			for (int i = 0; i < count; i++)
+			{
+				values[i] = interpolateTrilinear(*this, x[i], y[i], z[i], m_Width, m_Height, m_Depth);
+			}
+		}
+
+	private:
+
+		const unsigned short *const	*m_Bricks;
+		const float				*m_Lut;
+
+		BrickLayout				m_Layout;
+		int						m_Width;
+		int						m_Height;
+		int						m_Depth;
+
+};
@@ -0,0 +1,35 @@
+#include "VoxelConversion.h"
+#include "ConvertAvx2.h"
+#include "CpuFeatures.h"
+
+#include <string.h>
+
+
+//-------------------------------------------------------------------------------------------------
+// Voxel Conversion
+//-------------------------------------------------------------------------------------------------
+
+void convertVoxels(const unsigned short *values, float *voxels, size_t count)
+{
+	size_t i = useAvx2() ? convertAvx2(values, voxels, count) : 0;
+
+	for (; i < count; i++)
+	{
+		convertVoxel(values[i], voxels[i]);
+	}
+}
+
+void convertVoxels(const unsigned short *values, unsigned short *voxels, size_t count)
+{
+	memcpy(voxels, values, count * sizeof(unsigned short));
+}
+
+void convertVoxels(const unsigned short *values, unsigned char *voxels, size_t count)
+{
+	size_t i = useAvx2() ? convertAvx2(values, voxels, count) : 0;
+
+	for (; i < count; i++)
+	{
+		convertVoxel(values[i], voxels[i]);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+
+
+//-------------------------------------------------------------------------------------------------
+// Voxel Conversion
+//-------------------------------------------------------------------------------------------------
+
+// Conversion of the 16bit file values into the storage types of a volume.
+
+inline void convertVoxel(const unsigned short value, float &voxel)
+{
+	// data is converted to FLOAT values in an interval of [0.0 .. 1.0];
+	// uses 4095.0f to normalize the data, because only 12bit are used for the
+	// data values, and then 4095.0f is the maximum possible value
+	voxel = std::fmax(0.0f, std::fmin(1.0f, (float(value) / 4095.0f)));
+}
+
+inline void convertVoxel(const unsigned short value, unsigned short &voxel)
+{
+	voxel = value;
+}
+
+inline void convertVoxel(const unsigned short value, unsigned char &voxel)
+{
+	// rescale the 12bit range to 8bit with rounding; non-zero values stay non-zero,
+	// so that first hit finds the same voxels as with the full precision
+	const unsigned int clamped = std::min<unsigned int>(value, 4095);
+	voxel = (unsigned char)(clamped == 0 ? 0 : std::max<unsigned int>(1, (clamped * 255 + 2047) / 4095));
+}
+
+// converts count values with convertVoxel(); in blocks of 16 with AVX2 if the CPU has it,
+// which gives the same voxels
+void convertVoxels(const unsigned short *values, float *voxels, size_t count);
+void convertVoxels(const unsigned short *values, unsigned short *voxels, size_t count);
+void convertVoxels(const unsigned short *values, unsigned char *voxels, size_t count);